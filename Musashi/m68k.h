@@ -242,6 +242,15 @@ void m68k_set_reset_instr_callback(void  (*callback)(void));
 void m68k_set_pc_changed_callback(void  (*callback)(unsigned int new_pc));
 
 
+/* Set the callback for informing of a write to the S flag.
+ * You must enable M68K_MONITOR_SUPERVISOR in m68kconf.h.
+ * The CPU calls this callback with the new S flag (non-zero when in
+ * supervisor mode) every time it is written.
+ * Default behavior: do nothing.
+ */
+void m68k_set_supervisor_changed_callback(void  (*callback)(unsigned int supervisor));
+
+
 /* Set the callback for CPU function code changes.
  * You must enable M68K_EMULATE_FC in m68kconf.h.
  * The CPU calls this callback with the function code before every memory
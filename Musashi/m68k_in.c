@@ -109,11 +109,9 @@ XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
 M68KMAKE_PROTOTYPE_FOOTER
 
 
-/* Build the opcode handler table */
-void m68ki_build_opcode_table(void);
-
-extern void (*m68ki_instruction_jump_table[0x10000])(void); /* opcode handler jump table */
-extern unsigned char m68ki_cycles[][0x10000];
+/* Opcode handler jump table and cycle tables, statically built by m68kmake */
+extern void (*const m68ki_instruction_jump_table[0x10000])(void); /* opcode handler jump table */
+extern const unsigned char m68ki_cycles[][0x10000];
 
 
 /* ======================================================================== */
@@ -128,137 +126,28 @@ XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
 M68KMAKE_TABLE_HEADER
 
 /* ======================================================================== */
-/* ========================= OPCODE TABLE BUILDER ========================= */
+/* ========================= OPCODE HANDLER TABLE ========================= */
 /* ======================================================================== */
 
+/* The jump table and the cycle tables below are resolved by m68kmake when
+ * the opcode handlers are generated, rather than being built by
+ * m68k_init() at runtime, so no process spends time or writes pages on
+ * building them.  The cycle tables are plain const data, in read-only pages
+ * shared between all processes running the emulator.  The jump table holds
+ * function pointers, which a position independent executable has to
+ * relocate at load time, so it lands in .data.rel.ro and its pages are
+ * private to each process, only read-only after the relocation.
+ */
+
 #include "m68kops.h"
 
 #define NUM_CPU_TYPES 3
 
-void  (*m68ki_instruction_jump_table[0x10000])(void); /* opcode handler jump table */
-unsigned char m68ki_cycles[NUM_CPU_TYPES][0x10000]; /* Cycles used by CPU type */
-
-/* This is used to generate the opcode handler jump table */
-typedef struct
-{
-	void (*opcode_handler)(void);        /* handler function */
-	unsigned int  mask;                  /* mask on opcode */
-	unsigned int  match;                 /* what to match after masking */
-	unsigned char cycles[NUM_CPU_TYPES]; /* cycles each cpu type takes */
-} opcode_handler_struct;
-
-
-/* Opcode handler table */
-static opcode_handler_struct m68k_opcode_handler_table[] =
-{
-/*   function                      mask    match    000  010  020 */
-
 
 
 XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
 M68KMAKE_TABLE_FOOTER
 
-	{0, 0, 0, {0, 0, 0}}
-};
-
-
-/* Build the opcode handler jump table */
-void m68ki_build_opcode_table(void)
-{
-	opcode_handler_struct *ostruct;
-	int instr;
-	int i;
-	int j;
-	int k;
-
-	for(i = 0; i < 0x10000; i++)
-	{
-		/* default to illegal */
-		m68ki_instruction_jump_table[i] = m68k_op_illegal;
-		for(k=0;k<NUM_CPU_TYPES;k++)
-			m68ki_cycles[k][i] = 0;
-	}
-
-	ostruct = m68k_opcode_handler_table;
-	while(ostruct->mask != 0xff00)
-	{
-		for(i = 0;i < 0x10000;i++)
-		{
-			if((i & ostruct->mask) == ostruct->match)
-			{
-				m68ki_instruction_jump_table[i] = ostruct->opcode_handler;
-				for(k=0;k<NUM_CPU_TYPES;k++)
-					m68ki_cycles[k][i] = ostruct->cycles[k];
-			}
-		}
-		ostruct++;
-	}
-	while(ostruct->mask == 0xff00)
-	{
-		for(i = 0;i <= 0xff;i++)
-		{
-			m68ki_instruction_jump_table[ostruct->match | i] = ostruct->opcode_handler;
-			for(k=0;k<NUM_CPU_TYPES;k++)
-				m68ki_cycles[k][ostruct->match | i] = ostruct->cycles[k];
-		}
-		ostruct++;
-	}
-	while(ostruct->mask == 0xf1f8)
-	{
-		for(i = 0;i < 8;i++)
-		{
-			for(j = 0;j < 8;j++)
-			{
-				instr = ostruct->match | (i << 9) | j;
-				m68ki_instruction_jump_table[instr] = ostruct->opcode_handler;
-				for(k=0;k<NUM_CPU_TYPES;k++)
-					m68ki_cycles[k][instr] = ostruct->cycles[k];
-				if((instr & 0xf000) == 0xe000 && (!(instr & 0x20)))
-					m68ki_cycles[0][instr] = m68ki_cycles[1][instr] = ostruct->cycles[k] + ((((j-1)&7)+1)<<1);
-			}
-		}
-		ostruct++;
-	}
-	while(ostruct->mask == 0xfff0)
-	{
-		for(i = 0;i <= 0x0f;i++)
-		{
-			m68ki_instruction_jump_table[ostruct->match | i] = ostruct->opcode_handler;
-			for(k=0;k<NUM_CPU_TYPES;k++)
-				m68ki_cycles[k][ostruct->match | i] = ostruct->cycles[k];
-		}
-		ostruct++;
-	}
-	while(ostruct->mask == 0xf1ff)
-	{
-		for(i = 0;i <= 0x07;i++)
-		{
-			m68ki_instruction_jump_table[ostruct->match | (i << 9)] = ostruct->opcode_handler;
-			for(k=0;k<NUM_CPU_TYPES;k++)
-				m68ki_cycles[k][ostruct->match | (i << 9)] = ostruct->cycles[k];
-		}
-		ostruct++;
-	}
-	while(ostruct->mask == 0xfff8)
-	{
-		for(i = 0;i <= 0x07;i++)
-		{
-			m68ki_instruction_jump_table[ostruct->match | i] = ostruct->opcode_handler;
-			for(k=0;k<NUM_CPU_TYPES;k++)
-				m68ki_cycles[k][ostruct->match | i] = ostruct->cycles[k];
-		}
-		ostruct++;
-	}
-	while(ostruct->mask == 0xffff)
-	{
-		m68ki_instruction_jump_table[ostruct->match] = ostruct->opcode_handler;
-		for(k=0;k<NUM_CPU_TYPES;k++)
-			m68ki_cycles[k][ostruct->match] = ostruct->cycles[k];
-		ostruct++;
-	}
-}
-
-
 /* ======================================================================== */
 /* ============================== END OF FILE ============================= */
 /* ======================================================================== */
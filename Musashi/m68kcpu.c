@@ -45,10 +45,10 @@
 /* ================================= DATA ================================= */
 /* ======================================================================== */
 
-int  m68ki_initial_cycles;
-int  m68ki_remaining_cycles = 0;                     /* Number of clocks remaining */
-uint m68ki_tracing = 0;
-uint m68ki_address_space;
+M68K_THREAD_LOCAL int  m68ki_initial_cycles;
+M68K_THREAD_LOCAL int  m68ki_remaining_cycles = 0;   /* Number of clocks remaining */
+M68K_THREAD_LOCAL uint m68ki_tracing = 0;
+M68K_THREAD_LOCAL uint m68ki_address_space;
 
 #ifdef M68K_LOG_ENABLE
 char* m68ki_cpu_names[9] =
@@ -66,15 +66,15 @@ char* m68ki_cpu_names[9] =
 #endif /* M68K_LOG_ENABLE */
 
 /* The CPU core */
-m68ki_cpu_core m68ki_cpu = {0};
+M68K_THREAD_LOCAL m68ki_cpu_core m68ki_cpu = {0};
 
 #if M68K_EMULATE_ADDRESS_ERROR
-jmp_buf m68ki_aerr_trap;
+M68K_THREAD_LOCAL jmp_buf m68ki_aerr_trap;
 #endif /* M68K_EMULATE_ADDRESS_ERROR */
 
-uint    m68ki_aerr_address;
-uint    m68ki_aerr_write_mode;
-uint    m68ki_aerr_fc;
+M68K_THREAD_LOCAL uint    m68ki_aerr_address;
+M68K_THREAD_LOCAL uint    m68ki_aerr_write_mode;
+M68K_THREAD_LOCAL uint    m68ki_aerr_fc;
 
 /* Used by shift & rotate instructions */
 uint8 m68ki_shift_8_table[65] =
@@ -397,6 +397,13 @@ static void default_pc_changed_callback(unsigned int new_pc)
 	default_pc_changed_callback_data = new_pc;
 }
 
+/* Called when the S flag is written */
+static unsigned int default_supervisor_changed_callback_data;
+static void default_supervisor_changed_callback(unsigned int supervisor)
+{
+	default_supervisor_changed_callback_data = supervisor;
+}
+
 /* Called every time there's bus activity (read/write to/from memory */
 static unsigned int default_set_fc_callback_data;
 static void default_set_fc_callback(unsigned int new_fc)
@@ -552,6 +559,11 @@ void m68k_set_pc_changed_callback(void  (*callback)(unsigned int new_pc))
 	CALLBACK_PC_CHANGED = callback ? callback : default_pc_changed_callback;
 }
 
+void m68k_set_supervisor_changed_callback(void  (*callback)(unsigned int supervisor))
+{
+	CALLBACK_SUPERVISOR_CHANGED = callback ? callback : default_supervisor_changed_callback;
+}
+
 void m68k_set_fc_callback(void  (*callback)(unsigned int new_fc))
 {
 	CALLBACK_SET_FC = callback ? callback : default_set_fc_callback;
@@ -635,7 +647,8 @@ void m68k_set_cpu_type(unsigned int cpu_type)
 	}
 }
 
-/* Execute some instructions until we use up num_cycles clock cycles */
+/* Execute some instructions until we use up num_cycles clock cycles, or
+ * num_cycles instructions if M68K_EMULATE_CYCLES is off */
 /* ASG: removed per-instruction interrupt checks */
 int m68k_execute(int num_cycles)
 {
@@ -671,7 +684,7 @@ int m68k_execute(int num_cycles)
 			/* Read an instruction and call its handler */
 			REG_IR = m68ki_read_imm_16();
 			m68ki_instruction_jump_table[REG_IR]();
-			USE_CYCLES(CYC_INSTRUCTION[REG_IR]);
+			USE_INSTRUCTION_CYCLES();
 
 			/* Trace m68k_exception, if necessary */
 			m68ki_exception_if_trace(); /* auto-disable (see m68kcpu.h) */
@@ -716,7 +729,8 @@ void m68k_modify_timeslice(int cycles)
 
 void m68k_end_timeslice(void)
 {
-	m68ki_initial_cycles = GET_CYCLES();
+	/* Keep the count returned by m68k_execute() to the cycles actually used */
+	m68ki_initial_cycles -= GET_CYCLES();
 	SET_CYCLES(0);
 }
 
@@ -740,19 +754,13 @@ void m68k_set_irq(unsigned int int_level)
 
 void m68k_init(void)
 {
-	static uint emulation_initialized = 0;
-
-	/* The first call to this function initializes the opcode handler jump table */
-	if(!emulation_initialized)
-		{
-		m68ki_build_opcode_table();
-		emulation_initialized = 1;
-	}
+	/* The opcode handler jump table is statically built by m68kmake */
 
 	m68k_set_int_ack_callback(NULL);
 	m68k_set_bkpt_ack_callback(NULL);
 	m68k_set_reset_instr_callback(NULL);
 	m68k_set_pc_changed_callback(NULL);
+	m68k_set_supervisor_changed_callback(NULL);
 	m68k_set_fc_callback(NULL);
 	m68k_set_instr_hook_callback(NULL);
 }
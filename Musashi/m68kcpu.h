@@ -359,6 +359,7 @@
 #define CALLBACK_BKPT_ACK    m68ki_cpu.bkpt_ack_callback
 #define CALLBACK_RESET_INSTR m68ki_cpu.reset_instr_callback
 #define CALLBACK_PC_CHANGED  m68ki_cpu.pc_changed_callback
+#define CALLBACK_SUPERVISOR_CHANGED m68ki_cpu.supervisor_changed_callback
 #define CALLBACK_SET_FC      m68ki_cpu.set_fc_callback
 #define CALLBACK_INSTR_HOOK  m68ki_cpu.instr_hook_callback
 
@@ -471,6 +472,18 @@
 #endif /* M68K_MONITOR_PC */
 
 
+/* Enable or disable supervisor change monitoring */
+#if M68K_MONITOR_SUPERVISOR
+	#if M68K_MONITOR_SUPERVISOR == OPT_SPECIFY_HANDLER
+		#define m68ki_supervisor_changed(A) M68K_SET_SUPERVISOR_CALLBACK(A)
+	#else
+		#define m68ki_supervisor_changed(A) CALLBACK_SUPERVISOR_CHANGED(A)
+	#endif
+#else
+	#define m68ki_supervisor_changed(A)
+#endif /* M68K_MONITOR_SUPERVISOR */
+
+
 /* Enable or disable function code emulation */
 #if M68K_EMULATE_FC
 	#if M68K_EMULATE_FC == OPT_SPECIFY_HANDLER
@@ -511,7 +524,7 @@
 /* Address error */
 #if M68K_EMULATE_ADDRESS_ERROR
 	#include <setjmp.h>
-	extern jmp_buf m68ki_aerr_trap;
+	extern M68K_THREAD_LOCAL jmp_buf m68ki_aerr_trap;
 
 	#define m68ki_set_address_error_trap() \
 		if(setjmp(m68ki_aerr_trap) != 0) \
@@ -741,8 +754,18 @@
 
 /* ---------------------------- Cycle Counting ---------------------------- */
 
-#define ADD_CYCLES(A)    m68ki_remaining_cycles += (A)
+/* Without cycle emulation, the remaining "cycles" are simply the number
+ * of instructions left to execute in the current timeslice.
+ */
+#if M68K_EMULATE_CYCLES
 #define USE_CYCLES(A)    m68ki_remaining_cycles -= (A)
+#define USE_INSTRUCTION_CYCLES() USE_CYCLES(CYC_INSTRUCTION[REG_IR])
+#else
+#define USE_CYCLES(A)
+#define USE_INSTRUCTION_CYCLES() m68ki_remaining_cycles--
+#endif /* M68K_EMULATE_CYCLES */
+
+#define ADD_CYCLES(A)    m68ki_remaining_cycles += (A)
 #define SET_CYCLES(A)    m68ki_remaining_cycles = A
 #define GET_CYCLES()     m68ki_remaining_cycles
 #define USE_ALL_CYCLES() m68ki_remaining_cycles = 0
@@ -834,7 +857,7 @@ typedef struct
 	uint cyc_movem_l;
 	uint cyc_shift;
 	uint cyc_reset;
-	uint8* cyc_instruction;
+	const uint8* cyc_instruction;
 	uint8* cyc_exception;
 
 	/* Callbacks to host */
@@ -842,25 +865,26 @@ typedef struct
 	void (*bkpt_ack_callback)(unsigned int data);     /* Breakpoint Acknowledge */
 	void (*reset_instr_callback)(void);               /* Called when a RESET instruction is encountered */
 	void (*pc_changed_callback)(unsigned int new_pc); /* Called when the PC changes by a large amount */
+	void (*supervisor_changed_callback)(unsigned int supervisor); /* Called when the S flag is written */
 	void (*set_fc_callback)(unsigned int new_fc);     /* Called when the CPU function code changes */
 	void (*instr_hook_callback)(void);                /* Called every instruction cycle prior to execution */
 
 } m68ki_cpu_core;
 
 
-extern m68ki_cpu_core m68ki_cpu;
-extern sint           m68ki_remaining_cycles;
-extern uint           m68ki_tracing;
+extern M68K_THREAD_LOCAL m68ki_cpu_core m68ki_cpu;
+extern M68K_THREAD_LOCAL sint           m68ki_remaining_cycles;
+extern M68K_THREAD_LOCAL uint           m68ki_tracing;
 extern uint8          m68ki_shift_8_table[];
 extern uint16         m68ki_shift_16_table[];
 extern uint           m68ki_shift_32_table[];
 extern uint8          m68ki_exception_cycle_table[][256];
-extern uint           m68ki_address_space;
+extern M68K_THREAD_LOCAL uint           m68ki_address_space;
 extern uint8          m68ki_ea_idx_cycle_table[];
 
-extern uint           m68ki_aerr_address;
-extern uint           m68ki_aerr_write_mode;
-extern uint           m68ki_aerr_fc;
+extern M68K_THREAD_LOCAL uint           m68ki_aerr_address;
+extern M68K_THREAD_LOCAL uint           m68ki_aerr_write_mode;
+extern M68K_THREAD_LOCAL uint           m68ki_aerr_fc;
 
 /* Read data immediately after the program counter */
 INLINE uint m68ki_read_imm_16(void);
@@ -1386,6 +1410,7 @@ INLINE void m68ki_set_s_flag(uint value)
 	REG_SP_BASE[FLAG_S | ((FLAG_S>>1) & FLAG_M)] = REG_SP;
 	/* Set the S flag */
 	FLAG_S = value;
+	m68ki_supervisor_changed(FLAG_S);
 	/* Set the new stack pointer */
 	REG_SP = REG_SP_BASE[FLAG_S | ((FLAG_S>>1) & FLAG_M)];
 }
@@ -1400,6 +1425,7 @@ INLINE void m68ki_set_sm_flag(uint value)
 	/* Set the S and M flags */
 	FLAG_S = value & SFLAG_SET;
 	FLAG_M = value & MFLAG_SET;
+	m68ki_supervisor_changed(FLAG_S);
 	/* Set the new stack pointer */
 	REG_SP = REG_SP_BASE[FLAG_S | ((FLAG_S>>1) & FLAG_M)];
 }
@@ -1410,6 +1436,7 @@ INLINE void m68ki_set_sm_flag_nosp(uint value)
 	/* Set the S and M flags */
 	FLAG_S = value & SFLAG_SET;
 	FLAG_M = value & MFLAG_SET;
+	m68ki_supervisor_changed(FLAG_S);
 }
 
 
@@ -194,13 +194,13 @@ static void (*g_instruction_table[0x10000])(void);
 static int  g_initialized = 0;
 
 /* Address mask to simulate address lines */
-static unsigned int g_address_mask = 0xffffffff;
+static M68K_THREAD_LOCAL unsigned int g_address_mask = 0xffffffff;
 
-static char g_dasm_str[100]; /* string to hold disassembly */
-static char g_helper_str[100]; /* string to hold helpful info */
-static uint g_cpu_pc;        /* program counter */
-static uint g_cpu_ir;        /* instruction register */
-static uint g_cpu_type;
+static M68K_THREAD_LOCAL char g_dasm_str[100]; /* string to hold disassembly */
+static M68K_THREAD_LOCAL char g_helper_str[100]; /* string to hold helpful info */
+static M68K_THREAD_LOCAL uint g_cpu_pc;        /* program counter */
+static M68K_THREAD_LOCAL uint g_cpu_ir;        /* instruction register */
+static M68K_THREAD_LOCAL uint g_cpu_type;
 
 /* used by ops like asr, ror, addq, etc */
 static uint g_3bit_qdata_table[8] = {8, 1, 2, 3, 4, 5, 6, 7};
@@ -275,7 +275,7 @@ static int make_int_16(int value)
 /* Get string representation of hex values */
 static char* make_signed_hex_str_8(uint val)
 {
-	static char str[20];
+	static M68K_THREAD_LOCAL char str[20];
 
 	val &= 0xff;
 
@@ -291,7 +291,7 @@ static char* make_signed_hex_str_8(uint val)
 
 static char* make_signed_hex_str_16(uint val)
 {
-	static char str[20];
+	static M68K_THREAD_LOCAL char str[20];
 
 	val &= 0xffff;
 
@@ -307,7 +307,7 @@ static char* make_signed_hex_str_16(uint val)
 
 static char* make_signed_hex_str_32(uint val)
 {
-	static char str[20];
+	static M68K_THREAD_LOCAL char str[20];
 
 	val &= 0xffffffff;
 
@@ -325,7 +325,7 @@ static char* make_signed_hex_str_32(uint val)
 /* make string of immediate value */
 static char* get_imm_str_s(uint size)
 {
-	static char str[15];
+	static M68K_THREAD_LOCAL char str[15];
 	if(size == 0)
 		sprintf(str, "#%s", make_signed_hex_str_8(read_imm_8()));
 	else if(size == 1)
@@ -337,7 +337,7 @@ static char* get_imm_str_s(uint size)
 
 static char* get_imm_str_u(uint size)
 {
-	static char str[15];
+	static M68K_THREAD_LOCAL char str[15];
 	if(size == 0)
 		sprintf(str, "#$%x", read_imm_8() & 0xff);
 	else if(size == 1)
@@ -350,9 +350,9 @@ static char* get_imm_str_u(uint size)
 /* Make string of effective address mode */
 static char* get_ea_mode_str(uint instruction, uint size)
 {
-	static char b1[64];
-	static char b2[64];
-	static char* mode = b2;
+	static M68K_THREAD_LOCAL char b1[64];
+	static M68K_THREAD_LOCAL char b2[64];
+	static M68K_THREAD_LOCAL char* mode = NULL; /* Alternates between b1 and b2 */
 	uint extension;
 	uint base;
 	uint outer;
@@ -3287,7 +3287,7 @@ unsigned int m68k_disassemble(char* str_buff, unsigned int pc, unsigned int cpu_
 
 char* m68k_disassemble_quick(unsigned int pc, unsigned int cpu_type)
 {
-	static char buff[100];
+	static M68K_THREAD_LOCAL char buff[100];
 	buff[0] = 0;
 	m68k_disassemble(buff, pc, cpu_type);
 	return buff;
@@ -88,6 +88,9 @@ char* g_version = "3.3";
 #define EA_ALLOWED_LENGTH                11	/* Max length of ea allowed str */
 #define MAX_OPCODE_INPUT_TABLE_LENGTH  1000	/* Max length of opcode handler tbl */
 #define MAX_OPCODE_OUTPUT_TABLE_LENGTH 3000	/* Max length of opcode handler tbl */
+#define NUM_OPCODES                 0x10000	/* Size of the opcode jump table */
+#define JUMP_TABLE_ENTRIES_PER_LINE       3	/* Jump table entries per output line */
+#define CYCLE_TABLE_ENTRIES_PER_LINE     16	/* Cycle table entries per output line */
 
 /* Default filenames */
 #define FILENAME_INPUT      "m68k_in.c"
@@ -236,7 +239,9 @@ void write_function_name(FILE* filep, char* base_name);
 void add_opcode_output_table_entry(opcode_struct* op, char* name);
 static int DECL_SPEC compare_nof_true_bits(const void* aptr, const void* bptr);
 void print_opcode_output_table(FILE* filep);
-void write_table_entry(FILE* filep, opcode_struct* op);
+void build_opcode_jump_table(void);
+void write_opcode_jump_table(FILE* filep);
+void write_opcode_cycle_table(FILE* filep);
 void set_opcode_struct(opcode_struct* src, opcode_struct* dst, int ea_mode);
 void generate_opcode_handler(FILE* filep, body_struct* body, replace_struct* replace, opcode_struct* opinfo, int ea_mode);
 void generate_opcode_ea_variants(FILE* filep, body_struct* body, replace_struct* replace, opcode_struct* op);
@@ -272,6 +277,10 @@ opcode_struct g_opcode_input_table[MAX_OPCODE_INPUT_TABLE_LENGTH];
 opcode_struct g_opcode_output_table[MAX_OPCODE_OUTPUT_TABLE_LENGTH];
 int g_opcode_output_table_length = 0;
 
+/* Final jump table (as indexes into the output table) and cycle tables */
+int g_opcode_jump_table[NUM_OPCODES];
+unsigned char g_opcode_cycle_table[NUM_CPUS][NUM_OPCODES];
+
 ea_info_struct g_ea_info_table[13] =
 {/* fname    ea        mask  match */
 	{"",     "",       0x00, 0x00}, /* EA_MODE_NONE */
@@ -811,29 +820,133 @@ static int DECL_SPEC compare_nof_true_bits(const void* aptr, const void* bptr)
 
 void print_opcode_output_table(FILE* filep)
 {
-	int i;
 	qsort((void *)g_opcode_output_table, g_opcode_output_table_length, sizeof(g_opcode_output_table[0]), compare_nof_true_bits);
 
-	for(i=0;i<g_opcode_output_table_length;i++)
-		write_table_entry(filep, g_opcode_output_table+i);
+	build_opcode_jump_table();
+	write_opcode_jump_table(filep);
+	write_opcode_cycle_table(filep);
 }
 
-/* Write an entry in the opcode handler table */
-void write_table_entry(FILE* filep, opcode_struct* op)
+/* Set a jump table entry and its cycle counts from an output table entry */
+static void set_jump_table_entry(int instr, int index)
 {
+	int k;
+
+	g_opcode_jump_table[instr] = index;
+	for(k=0;k<NUM_CPUS;k++)
+		g_opcode_cycle_table[k][instr] = g_opcode_output_table[index].cycles[k];
+}
+
+/*
+ * Resolve the opcode handler for every possible opcode.
+ * This walks the sorted output table exactly the way the runtime table
+ * builder used to do, so that the generated tables are identical to the
+ * ones previously built by m68k_init().
+ */
+void build_opcode_jump_table(void)
+{
+	opcode_struct* illegal = NULL;
+	opcode_struct* op;
+	int n = g_opcode_output_table_length;
+	int o = 0;
+	int instr;
 	int i;
+	int j;
 
-	fprintf(filep, "\t{%-28s, 0x%04x, 0x%04x, {",
-		op->name, op->op_mask, op->op_match);
+	for(i=0;i<n;i++)
+		if(strcmp(g_opcode_output_table[i].name, "m68k_op_illegal") == 0)
+			illegal = g_opcode_output_table + i;
+	if(illegal == NULL)
+		error_exit("Unable to find the illegal opcode handler");
 
-	for(i=0;i<NUM_CPUS;i++)
+	/* default to illegal, with no cycles */
+	for(i=0;i<NUM_OPCODES;i++)
+	{
+		g_opcode_jump_table[i] = illegal - g_opcode_output_table;
+		for(j=0;j<NUM_CPUS;j++)
+			g_opcode_cycle_table[j][i] = 0;
+	}
+
+	for(;o < n && g_opcode_output_table[o].op_mask != 0xff00;o++)
+	{
+		op = g_opcode_output_table + o;
+		for(i=0;i<NUM_OPCODES;i++)
+			if((i & op->op_mask) == op->op_match)
+				set_jump_table_entry(i, o);
+	}
+	for(;o < n && g_opcode_output_table[o].op_mask == 0xff00;o++)
+		for(i=0;i<=0xff;i++)
+			set_jump_table_entry(g_opcode_output_table[o].op_match | i, o);
+	for(;o < n && g_opcode_output_table[o].op_mask == 0xf1f8;o++)
+	{
+		op = g_opcode_output_table + o;
+		for(i=0;i<8;i++)
+		{
+			for(j=0;j<8;j++)
+			{
+				instr = op->op_match | (i << 9) | j;
+				set_jump_table_entry(instr, o);
+				/* Register shifts take 2 extra cycles per shifted bit on
+				 * 000/010.  The runtime builder used the (always zero)
+				 * padding after the cycles array as the base here. */
+				if((instr & 0xf000) == 0xe000 && (!(instr & 0x20)))
+					g_opcode_cycle_table[0][instr] = g_opcode_cycle_table[1][instr] = ((((j-1)&7)+1)<<1);
+			}
+		}
+	}
+	for(;o < n && g_opcode_output_table[o].op_mask == 0xfff0;o++)
+		for(i=0;i<=0x0f;i++)
+			set_jump_table_entry(g_opcode_output_table[o].op_match | i, o);
+	for(;o < n && g_opcode_output_table[o].op_mask == 0xf1ff;o++)
+		for(i=0;i<=0x07;i++)
+			set_jump_table_entry(g_opcode_output_table[o].op_match | (i << 9), o);
+	for(;o < n && g_opcode_output_table[o].op_mask == 0xfff8;o++)
+		for(i=0;i<=0x07;i++)
+			set_jump_table_entry(g_opcode_output_table[o].op_match | i, o);
+	for(;o < n && g_opcode_output_table[o].op_mask == 0xffff;o++)
+		set_jump_table_entry(g_opcode_output_table[o].op_match, o);
+}
+
+/* Write the statically initialised opcode handler jump table */
+void write_opcode_jump_table(FILE* filep)
+{
+	int i;
+
+	fprintf(filep, "void (*const m68ki_instruction_jump_table[0x%x])(void) = /* opcode handler jump table */\n{\n", NUM_OPCODES);
+	for(i=0;i<NUM_OPCODES;i++)
 	{
-		fprintf(filep, "%3d", op->cycles[i]);
-		if(i < NUM_CPUS-1)
-			fprintf(filep, ", ");
+		if(i % JUMP_TABLE_ENTRIES_PER_LINE == 0)
+			fprintf(filep, "\t");
+		fprintf(filep, "%s,", g_opcode_output_table[g_opcode_jump_table[i]].name);
+		if(i % JUMP_TABLE_ENTRIES_PER_LINE == JUMP_TABLE_ENTRIES_PER_LINE-1 || i == NUM_OPCODES-1)
+			fprintf(filep, "\n");
+		else
+			fprintf(filep, " ");
 	}
+	fprintf(filep, "};\n\n");
+}
+
+/* Write the statically initialised cycle tables, one per CPU type */
+void write_opcode_cycle_table(FILE* filep)
+{
+	int i;
+	int k;
 
-	fprintf(filep, "}},\n");
+	fprintf(filep, "const unsigned char m68ki_cycles[NUM_CPU_TYPES][0x%x] = /* Cycles used by CPU type */\n{\n", NUM_OPCODES);
+	for(k=0;k<NUM_CPUS;k++)
+	{
+		fprintf(filep, "\t{\n");
+		for(i=0;i<NUM_OPCODES;i++)
+		{
+			if(i % CYCLE_TABLE_ENTRIES_PER_LINE == 0)
+				fprintf(filep, "\t\t");
+			fprintf(filep, "%3d,", g_opcode_cycle_table[k][i]);
+			if(i % CYCLE_TABLE_ENTRIES_PER_LINE == CYCLE_TABLE_ENTRIES_PER_LINE-1)
+				fprintf(filep, "\n");
+		}
+		fprintf(filep, "\t},\n");
+	}
+	fprintf(filep, "};\n\n");
 }
 
 /* Fill out an opcode struct with a specific addressing mode of the source opcode struct */
@@ -0,0 +1,282 @@
+/*
+ * TOSEMU - an emulated environment for TOS applications
+ * Copyright (C) 2014 Johan Thelin <e8johan@gmail.com>
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#include "batch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/limits.h>
+
+#include "tossystem.h"
+#include "sched.h"
+
+struct batch_job {
+    int line;
+    char *text; /* Copy of the manifest line, holding the strings below */
+    char *cwd, *in, *out, *err;
+    struct tos_limits limits;
+    int bad_limit; /* Set by an invalid limit field, the job is not started */
+    int argc;
+    char **argv; /* The binary followed by its arguments */
+    struct batch *b;
+    struct sched_task task;
+    struct tos_environment te;
+    struct timespec start;
+};
+
+struct batch {
+    struct batch_job *jobs;
+    int count;
+    int failed;
+    pthread_mutex_t lock;
+};
+
+/* Splits a manifest line into a job, returns 0 if the line holds no job */
+static int parse_job(struct batch_job *job, char *text, int line, 
+                     const struct tos_limits *limits)
+{
+    char *tok, *save;
+    
+    memset(job, 0, sizeof(struct batch_job));
+    job->line = line;
+    job->limits = *limits;
+    job->text = text;
+    job->argv = text ? malloc((strlen(text) / 2 + 2) * sizeof(char *)) : NULL;
+    if (!job->argv)
+    {
+        free(text);
+        return 0;
+    }
+    
+    for (tok = strtok_r(text, " \t\n", &save); tok; tok = strtok_r(NULL, " \t\n", &save))
+    {
+        if (job->argc == 0 && tok[0] == '#')
+            break;
+        else if (job->argc == 0 && strncmp("cwd=", tok, 4) == 0)
+            job->cwd = tok + 4;
+        else if (job->argc == 0 && strncmp("stdin=", tok, 6) == 0)
+            job->in = tok + 6;
+        else if (job->argc == 0 && strncmp("stdout=", tok, 7) == 0)
+            job->out = tok + 7;
+        else if (job->argc == 0 && strncmp("stderr=", tok, 7) == 0)
+            job->err = tok + 7;
+        else if (job->argc == 0 && strncmp("max-", tok, 4) == 0)
+        {
+            if (parse_tos_limit(&job->limits, tok))
+                job->bad_limit = 1;
+        }
+        else
+            job->argv[job->argc++] = tok;
+    }
+    
+    if (job->argc == 0)
+    {
+        free(job->argv);
+        free(text);
+        return 0;
+    }
+    
+    return 1;
+}
+
+static int read_manifest(struct batch *b, const char *manifest, 
+                         const struct tos_limits *limits)
+{
+    FILE *f;
+    char *text = NULL;
+    size_t size = 0;
+    int line = 0;
+    
+    f = fopen(manifest, "r");
+    if (!f)
+    {
+        printf("Error: failed to open '%s'\n", manifest);
+        return -1;
+    }
+    
+    while (getline(&text, &size, f) != -1)
+    {
+        struct batch_job *jobs;
+        
+        line++;
+        jobs = realloc(b->jobs, (b->count + 1) * sizeof(struct batch_job));
+        if (!jobs)
+            break;
+        b->jobs = jobs;
+        
+        if (parse_job(&b->jobs[b->count], strdup(text), line, limits))
+            b->count++;
+    }
+    
+    free(text);
+    fclose(f);
+    
+    return 0;
+}
+
+/* Resolves a job file name relative to the working directory of the job */
+static FILE *open_job_file(const char *cwd, const char *name, const char *fallback, const char *mode)
+{
+    char path[PATH_MAX];
+    
+    if (!name)
+        return fopen(fallback, mode);
+    
+    if (name[0] == '/')
+        return fopen(name, mode);
+    
+    if (snprintf(path, sizeof path, "%s/%s", cwd, name) >= sizeof path)
+        return NULL;
+    return fopen(path, mode);
+}
+
+/* Prepares the environment of a job, returns -1 if it could not be started */
+static int start_job(struct sched_task *task)
+{
+    struct batch_job *job = task->data;
+    struct tos_environment *te = &job->te;
+    char path[PATH_MAX];
+    
+    clock_gettime(CLOCK_MONOTONIC, &job->start);
+    
+    if (job->bad_limit)
+    {
+        printf("Error: invalid limit in line %d\n", job->line);
+        return -1;
+    }
+    te->limits = job->limits;
+    te->name = job->argv[0];
+    
+    if (job->cwd ? !realpath(job->cwd, te->cwd) : !getcwd(te->cwd, sizeof te->cwd))
+    {
+        printf("Error: invalid working directory in line %d\n", job->line);
+        return -1;
+    }
+    
+    te->con_in = open_job_file(te->cwd, job->in, "/dev/null", "r");
+    te->con_out = open_job_file(te->cwd, job->out, "/dev/null", "w");
+    te->con_err = open_job_file(te->cwd, job->err, "/dev/null", "w");
+    
+    if (!te->con_in || !te->con_out || !te->con_err)
+    {
+        printf("Error: failed to open stdio files in line %d\n", job->line);
+        return -1;
+    }
+    
+    if (job->argv[0][0] != '/' &&
+        snprintf(path, sizeof path, "%s/%s", te->cwd, job->argv[0]) >= sizeof path)
+    {
+        printf("Error: path too long in line %d\n", job->line);
+        return -1;
+    }
+    
+    return load_tos_binary(te, job->argv[0][0] == '/' ? job->argv[0] : path,
+                           job->argc - 1, job->argv + 1) ? -1 : 0;
+}
+
+/* Reports a job and releases its environment, status is -1 if the job could 
+ * not be started */
+static void finish_job(struct sched_task *task, int status)
+{
+    struct batch_job *job = task->data;
+    struct tos_environment *te = &job->te;
+    struct timespec end;
+    long ms;
+    
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    ms = (end.tv_sec - job->start.tv_sec) * 1000 + (end.tv_nsec - job->start.tv_nsec) / 1000000;
+    
+    free_tos_environment(te);
+    
+    if (te->con_in)
+        fclose(te->con_in);
+    if (te->con_out)
+        fclose(te->con_out);
+    if (te->con_err)
+        fclose(te->con_err);
+    
+    /* Result lines are written whole, in the order the jobs finish */
+    flockfile(stdout);
+    if (status < 0)
+        printf("%d\terror\t%ld\t%s\n", job->line, ms, job->argv[0]);
+    else
+        printf("%d\t%d\t%ld\t%s\n", job->line, status & 0xff, ms, job->argv[0]);
+    fflush(stdout);
+    funlockfile(stdout);
+    
+    if (status < 0)
+    {
+        pthread_mutex_lock(&job->b->lock);
+        job->b->failed = 1;
+        pthread_mutex_unlock(&job->b->lock);
+    }
+}
+
+int run_batch(const char *manifest, const struct tos_limits *limits)
+{
+    struct batch b;
+    struct sched_task **tasks;
+    long n, i;
+    
+    memset(&b, 0, sizeof b);
+    pthread_mutex_init(&b.lock, NULL);
+    
+    if (read_manifest(&b, manifest, limits))
+        return -1;
+    
+    tasks = malloc((b.count + 1) * sizeof(struct sched_task *));
+    if (!tasks)
+        return -1;
+    
+    for (i = 0; i < b.count; i++)
+    {
+        struct batch_job *job = &b.jobs[i];
+        
+        job->b = &b;
+        job->task.te = &job->te;
+        job->task.start = start_job;
+        job->task.finish = finish_job;
+        job->task.data = job;
+        tasks[i] = &job->task;
+    }
+    
+    /* One worker per core, but never more than there are jobs */
+    n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n > b.count)
+        n = b.count;
+    if (n < 1)
+        n = sysconf(_SC_NPROCESSORS_ONLN);
+    
+    sched_run(tasks, b.count, n);
+    
+    free(tasks);
+    for (i = 0; i < b.count; i++)
+    {
+        free(b.jobs[i].argv);
+        free(b.jobs[i].text);
+    }
+    free(b.jobs);
+    
+    return b.failed;
+}
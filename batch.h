@@ -0,0 +1,51 @@
+/*
+ * TOSEMU - an emulated environment for TOS applications
+ * Copyright (C) 2014 Johan Thelin <e8johan@gmail.com>
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "tossystem.h"
+
+/* Batch mode
+ *
+ * Runs the jobs listed in a manifest file on the scheduler, see sched.h, 
+ * with one worker thread per host core. Every line of the manifest describes
+ * a job:
+ *
+ *   [cwd=<dir>] [stdin=<file>] [stdout=<file>] [stderr=<file>] 
+ *   [max-instructions=<n>] [max-time=<ms>] [max-memory=<bytes>] <binary> [<args>]
+ *
+ * Fields are separated by white space, empty lines and lines starting with #
+ * are ignored. The binary and the stdio files are relative to the working 
+ * directory of the job, which is relative to the working directory of tosemu.
+ * Console input is empty and output is discarded unless redirected, stderr 
+ * is GEMDOS handle 2. The max- fields override the limits given to tosemu,
+ * a job stopped by a limit exits with TOS_LIMIT_EXIT.
+ *
+ * A tab separated result line is printed for each job as it finishes:
+ *
+ *   <manifest line> <exit code, or "error" if not started> <milliseconds> <binary>
+ */
+
+/* Runs all jobs, with limits as the default for the limits of a job, see 
+ * struct tos_limits. Returns 0 if all of them could be started. */
+int run_batch(const char *manifest, const struct tos_limits *limits);
+
+#endif /* BATCH_H */
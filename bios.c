@@ -28,39 +28,32 @@
 #include "cpu.h"
 #include "m68k.h"
 #include "utils.h"
+#include "trace.h"
 
-#define BIOS_TRACE_CONTEXT
-#include "config.h"
-
-uint32_t BIOS_Setexc()
+uint32_t BIOS_Setexc(const uint32_t *args)
 {
-    uint16_t nm = peek_u16(2);
-    uint32_t vec = peek_u32(4);
+    uint16_t nm = args[0];
+    uint32_t vec = args[1];
     uint32_t old;
 
-    FUNC_TRACE_ENTER_ARGS {
-        printf("    nm: 0x%x, vec: 0x%x\n", nm, vec);
-    }
-
     old = m68k_read_memory_32(4*nm);
     m68k_write_memory_32(4*nm, vec);
 
     return old;
 }
 
-uint32_t BIOS_Bconin()
+uint32_t BIOS_Bconin(const uint32_t *args)
 {
-    uint16_t dev = peek_u16(2);
-    
-    FUNC_TRACE_ENTER_ARGS {
-        printf("    0x%x\n", dev);
-    }
+    uint16_t dev = args[0];
     
     switch(dev)
     {
     case 2: /* console */
         if (console_input_available())
-            return getchar() & 0xff;
+        {
+            tos_current->stats.console_in++;
+            return getc(tos_current->con_in) & 0xff;
+        }
         else
             return 0;
     default:
@@ -68,31 +61,24 @@ uint32_t BIOS_Bconin()
     }
 }
 
-uint32_t BIOS_Bconout()
+uint32_t BIOS_Bconout(const uint32_t *args)
 {
-    uint16_t dev = peek_u16(2);
-    uint16_t c = peek_u16(4);
-    
-    FUNC_TRACE_ENTER_ARGS {
-        printf("    dev: 0x%x, c: 0x%x '%c'\n", dev, c, c);
-    }
+    uint16_t dev = args[0];
+    uint16_t c = args[1];
     
     switch(dev)
     {
     case 2: /* console */
-        putchar(c);
+        putc(c, tos_current->con_out);
+        tos_current->stats.console_out++;
     default:
         return 0; /* TODO support writing to additional devices */
     }
 }
 
-uint32_t BIOS_Bconstat()
+uint32_t BIOS_Bconstat(const uint32_t *args)
 {
-    uint16_t dev = peek_u16(2);
-    
-    FUNC_TRACE_ENTER_ARGS {
-        printf("    0x%x\n", dev);
-    }    
+    uint16_t dev = args[0];
     
     switch(dev)
     {
@@ -106,13 +92,9 @@ uint32_t BIOS_Bconstat()
     }
 }            
 
-uint32_t BIOS_Bcostat()
+uint32_t BIOS_Bcostat(const uint32_t *args)
 {
-    uint16_t dev = peek_u16(2);
-    
-    FUNC_TRACE_ENTER_ARGS {
-        printf("    0x%x\n", dev);
-    }
+    uint16_t dev = args[0];
     
     switch(dev)
     {
@@ -138,44 +120,60 @@ uint32_t BIOS_Bcostat()
  */
 struct BIOS_function {
     char *name;
-    uint32_t (*fnct)();
+    uint32_t (*fnct)(const uint32_t *args);
     uint16_t id;
+    const char *args; /* Argument signature, see decode_trap_args */
 };
 
 struct BIOS_function BIOS_functions[] = {
-    {"Bconin", BIOS_Bconin, 0x02},
-    {"Bconout", BIOS_Bconout, 0x03},
-    {"Bconstat", BIOS_Bconstat, 0x01},
-    {"Bcostat", BIOS_Bcostat, 0x08},
+    {"Bconin", BIOS_Bconin, 0x02, "w"},
+    {"Bconout", BIOS_Bconout, 0x03, "ww"},
+    {"Bconstat", BIOS_Bconstat, 0x01, "w"},
+    {"Bcostat", BIOS_Bcostat, 0x08, "w"},
     {"Drvmap", BIOS_Drvmap, 0x0A},
     {"Getbpb", BIOS_Getbpb, 0x07},
     {"Getmpb", BIOS_Getmpb, 0x00},
     {"Kbshift", BIOS_Kbshift, 0x0B},
     {"Mediach", BIOS_Mediach, 0x09},
     {"Rwabs", BIOS_Rwabs, 0x04},
-    {"Setexc", BIOS_Setexc, 0x05},
+    {"Setexc", BIOS_Setexc, 0x05, "wp"},
     {"Tickcal", BIOS_Tickcal, 0x06}
 };
 
+const char *bios_function_name(int i)
+{
+    if (i < 0 || i >= sizeof(BIOS_functions)/sizeof(struct BIOS_function))
+        return 0;
+    
+    return BIOS_functions[i].name;
+}
+
 void bios_trap()
 {
     uint16_t fnct = peek_u16(0);
+    uint32_t args[TRAP_ARGS_MAX];
     int i;
     
-    for(i=0; i<=sizeof(BIOS_functions)/sizeof(struct BIOS_function); ++i) {
+    for(i=0; i<sizeof(BIOS_functions)/sizeof(struct BIOS_function); ++i) {
         if (BIOS_functions[i].id == fnct) {
             if (BIOS_functions[i].fnct) {
-                uint32_t r = BIOS_functions[i].fnct();
-#ifdef ENABLE_BIOS_TRACE
-                printf("Return from %s: %d = 0x%x\n",
-                       BIOS_functions[i].name, r, r);
-#endif
+                uint32_t r;
+                
+                decode_trap_args(BIOS_functions[i].args, args);
+                if (TRACING(STATS_BIOS))
+                    r = trace_call(STATS_BIOS, BIOS_functions[i].name, BIOS_functions[i].args,
+                                   BIOS_functions[i].fnct, args);
+                else
+                    r = BIOS_functions[i].fnct(args);
                 m68k_set_reg(M68K_REG_D0, r);
             } else {
                 halt_execution();
                 printf("BIOS %s (0x%x) not implemented\n", BIOS_functions[i].name, fnct);
             }
             
+            /* A parked call is counted once it is retried and completes */
+            if (!TRAP_PARKED())
+                STATS_CALL(STATS_BIOS, i);
             return;
         }
     }
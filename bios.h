@@ -23,4 +23,7 @@
 
 void bios_trap();
 
+/* Returns the name of the function at index in the dispatch table, or 0 */
+const char *bios_function_name(int index);
+
 #endif /* BIOS_H */
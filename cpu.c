@@ -20,8 +20,14 @@
 
 #include "cpu.h"
 
+#include <stdio.h>
+#include <stdarg.h>
+#include <ctype.h>
+
 #include "utils.h"
+#include "memory.h"
 #include "m68k.h"
+#include "verify.h"
 
 void enable_supervisor_mode()
 {
@@ -108,3 +114,110 @@ int32_t peek_s32(int offset)
 {
     return (int32_t)peek_u32(offset);
 }
+
+static int trap_arg_size(char type)
+{
+    return (type == 'w') ? 2 : 4;
+}
+
+/* Reads a trap argument through the memory functions */
+static uint32_t read_trap_arg(char type, uint32_t address)
+{
+    if (type == 'w')
+        return m68k_read_disassembler_16(address);
+    else
+        return m68k_read_disassembler_32(address);
+}
+
+int decode_trap_args(const char *signature, uint32_t *args)
+{
+    uint32_t sp = m68k_get_reg(0, M68K_REG_A7) + 2; /* skip the function number */
+    uint8_t *p;
+    uint32_t len = 0;
+    int i;
+
+    if (!signature)
+        return 0;
+
+    for(i=0; signature[i] && i<TRAP_ARGS_MAX; ++i)
+        len += trap_arg_size(signature[i]);
+
+    p = tos_range_to_host_mem(sp, len);
+
+    for(i=0; signature[i] && i<TRAP_ARGS_MAX; ++i) {
+        if (p) {
+            if (signature[i] == 'w')
+                args[i] = (p[0] << 8) | p[1];
+            else
+                args[i] = ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+            p += trap_arg_size(signature[i]);
+            
+            if (VERIFYING() && args[i] != read_trap_arg(signature[i], sp))
+                verify_failed("trap argument %d at 0x%x is 0x%x, read as 0x%x",
+                              i, sp, args[i], read_trap_arg(signature[i], sp));
+        } else {
+            /* The stack straddles memory areas, fall back to the slow path */
+            args[i] = read_trap_arg(signature[i], sp);
+        }
+        sp += trap_arg_size(signature[i]);
+    }
+
+    return i;
+}
+
+/* Appends to the string of length *len in buf, cutting it at size */
+static void append(char *buf, size_t size, size_t *len, const char *format, ...)
+{
+    va_list ap;
+    int n;
+
+    va_start(ap, format);
+    n = vsnprintf(buf + *len, size - *len, format, ap);
+    va_end(ap);
+
+    if (n > 0)
+        *len = (*len + n < size) ? *len + n : size - 1;
+}
+
+size_t format_trap_args(char *buf, size_t size, const char *name,
+                        const char *signature, const uint32_t *args)
+{
+    size_t len = 0;
+    const uint8_t *p;
+    uint32_t c, avail;
+    int i, j;
+
+    buf[0] = 0;
+    append(buf, size, &len, "%s(", name);
+    for(i=0; signature && signature[i] && i<TRAP_ARGS_MAX; ++i) {
+        if (i)
+            append(buf, size, &len, ", ");
+
+        switch(signature[i])
+        {
+        case 'w':
+            append(buf, size, &len, "%d", (int16_t)args[i]);
+            break;
+        case 'l':
+            append(buf, size, &len, "%d", (int32_t)args[i]);
+            break;
+        case 's':
+            /* Tracing must not fault the guest on a bad pointer */
+            if (!(p = tos_host_mem_extent(args[i], &avail))) {
+                append(buf, size, &len, "0x%x <bad ptr>", args[i]);
+                break;
+            }
+            append(buf, size, &len, "0x%x \"", args[i]);
+            for(j=0; j<64 && j<avail && (c = p[j]); ++j)
+                append(buf, size, &len, "%c", isprint(c) ? c : '.');
+            append(buf, size, &len, "\"");
+            break;
+        default:
+            append(buf, size, &len, "0x%x", args[i]);
+            break;
+        }
+    }
+    append(buf, size, &len, ")");
+
+    return len;
+}
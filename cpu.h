@@ -22,6 +22,7 @@
 #define CPU_H
 
 #include <stdint.h>
+#include <stddef.h>
 
 /* Enable, disable and check supervisor mode */
 void enable_supervisor_mode();
@@ -48,4 +49,26 @@ int8_t peek_s8(int offset);
 int16_t peek_s16(int offset);
 int32_t peek_s32(int offset);
 
+/* Decode the arguments of a trap call.
+ *
+ * The signature lists the arguments following the function number on the
+ * stack, one character per argument:
+ *   'w' - word
+ *   'l' - long word
+ *   'p' - pointer
+ *   's' - pointer to a zero terminated string
+ *
+ * The stack is resolved to host memory once for the entire argument block.
+ * Values are stored into args in host system endianess, and the number of
+ * decoded arguments is returned. A NULL signature decodes no arguments.
+ */
+#define TRAP_ARGS_MAX (8)
+
+int decode_trap_args(const char *signature, uint32_t *args);
+
+/* Formats a call of name with decoded trap arguments according to their
+ * signature into buf, cut at size, returns the length of the string */
+size_t format_trap_args(char *buf, size_t size, const char *name,
+                        const char *signature, const uint32_t *args);
+
 #endif /* CPU_H */
@@ -0,0 +1,173 @@
+/*
+ * TOSEMU - an emulated environment for TOS applications
+ * Copyright (C) 2014 Johan Thelin <e8johan@gmail.com>
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#include "disasm.h"
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <string.h>
+
+#include "m68k.h"
+#include "verify.h"
+
+/* Longest 68000 instruction, which may straddle two pages */
+#define INSTRUCTION_MAX (10)
+
+#define PAGES (RAMSIZE >> DISASM_PAGE_SHIFT)
+
+int disasm_tracking;
+
+static pthread_once_t opcode_table_once = PTHREAD_ONCE_INIT;
+
+struct disasm_entry {
+    uint32_t pc;
+    uint32_t generation; /* Of the pages of the instruction when disassembled */
+    uint64_t executions; /* Zero for a free slot */
+    char text[DISASM_TEXT_MAX];
+};
+
+struct disasm_cache {
+    uint32_t generation[PAGES];
+    
+    /* Open addressing hash table by PC, at most half full */
+    struct disasm_entry *entries;
+    uint32_t slots, used;
+};
+
+static uint32_t page_generation(struct disasm_cache *dc, uint32_t pc)
+{
+    return dc->generation[(pc >> DISASM_PAGE_SHIFT) & (PAGES - 1)] +
+           dc->generation[((pc + INSTRUCTION_MAX - 1) >> DISASM_PAGE_SHIFT) & (PAGES - 1)];
+}
+
+static struct disasm_entry *find_entry(struct disasm_entry *entries, uint32_t slots, uint32_t pc)
+{
+    uint32_t i = ((pc >> 1) * 2654435761u) & (slots - 1);
+    
+    while (entries[i].executions && entries[i].pc != pc)
+        i = (i + 1) & (slots - 1);
+    
+    return &entries[i];
+}
+
+static int grow_entries(struct disasm_cache *dc)
+{
+    uint32_t slots = dc->slots ? dc->slots * 2 : 4096;
+    struct disasm_entry *entries = calloc(slots, sizeof(struct disasm_entry));
+    uint32_t i;
+    
+    if (!entries)
+        return -1;
+    
+    for (i = 0; i < dc->slots; i++)
+        if (dc->entries[i].executions)
+            *find_entry(entries, slots, dc->entries[i].pc) = dc->entries[i];
+    
+    free(dc->entries);
+    dc->entries = entries;
+    dc->slots = slots;
+    
+    return 0;
+}
+
+static void verify_disassembly(const struct disasm_entry *e)
+{
+    char text[DISASM_TEXT_MAX];
+    
+    m68k_disassemble(text, e->pc, M68K_CPU_TYPE_68000);
+    if (strcmp(text, e->text))
+        verify_failed("cached disassembly at 0x%x is \"%s\", decoded as \"%s\"",
+                      e->pc, e->text, text);
+}
+
+/* The opcode table of the disassembler is shared by all threads, build it 
+ * before any of them disassembles */
+static void build_opcode_table(void)
+{
+    m68k_is_valid_instruction(0, M68K_CPU_TYPE_68000);
+}
+
+const char *disasm_execute(uint32_t pc, uint64_t *executions)
+{
+    static __thread char uncached[DISASM_TEXT_MAX];
+    struct disasm_cache *dc = tos_current->disasm;
+    struct disasm_entry *e;
+    uint32_t generation;
+    
+    pthread_once(&opcode_table_once, build_opcode_table);
+    if (!dc && !(dc = tos_current->disasm = calloc(1, sizeof(struct disasm_cache))))
+        goto uncached;
+    if ((dc->used + 1) * 2 > dc->slots && grow_entries(dc))
+        goto uncached;
+    
+    generation = page_generation(dc, pc);
+    e = find_entry(dc->entries, dc->slots, pc);
+    if (!e->executions) {
+        e->pc = pc;
+        dc->used++;
+    } else if (e->generation == generation) {
+        if (VERIFYING())
+            verify_disassembly(e);
+        *executions = ++e->executions;
+        return e->text;
+    }
+    
+    m68k_disassemble(e->text, pc, M68K_CPU_TYPE_68000);
+    e->generation = generation;
+    *executions = ++e->executions;
+    return e->text;
+    
+uncached:
+    m68k_disassemble(uncached, pc, M68K_CPU_TYPE_68000);
+    *executions = 1;
+    return uncached;
+}
+
+void disasm_invalidate(uint32_t address)
+{
+    struct disasm_cache *dc = tos_current->disasm;
+    
+    if (dc)
+        dc->generation[(address >> DISASM_PAGE_SHIFT) & (PAGES - 1)]++;
+}
+
+void disasm_invalidate_range(uint32_t address, uint32_t len)
+{
+    struct disasm_cache *dc = tos_current->disasm;
+    uint32_t page, last;
+    
+    if (!dc || len == 0)
+        return;
+    
+    page = address >> DISASM_PAGE_SHIFT;
+    last = (address + len - 1) >> DISASM_PAGE_SHIFT;
+    if (last - page >= PAGES)
+        last = page + PAGES - 1;
+    for (; page <= last; page++)
+        dc->generation[page & (PAGES - 1)]++;
+}
+
+void disasm_free(struct tos_environment *te)
+{
+    if (te->disasm)
+        free(te->disasm->entries);
+    free(te->disasm);
+    te->disasm = 0;
+}
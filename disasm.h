@@ -0,0 +1,61 @@
+/*
+ * TOSEMU - an emulated environment for TOS applications
+ * Copyright (C) 2014 Johan Thelin <e8johan@gmail.com>
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#ifndef DISASM_H
+#define DISASM_H
+
+#include <stdint.h>
+
+#include "tossystem.h"
+
+/* Disassembly cache of the -v instruction trace
+ *
+ * Each environment memoises the disassembly of the instructions it executes,
+ * keyed by PC, along with the number of times each PC was executed. Writes
+ * through the memory functions, and those through host pointers, bump a 
+ * generation counter of the 256 byte page written to, and an entry is 
+ * disassembled again if the generation of the pages of its instruction 
+ * changed since, so self-modifying and loaded code is traced as it is when 
+ * executed.
+ */
+
+#define DISASM_TEXT_MAX (100)
+#define DISASM_PAGE_SHIFT (8)
+
+/* Non-zero while the instruction trace is on, makes writes invalidate */
+extern int disasm_tracking;
+
+#define DISASM_TRACKING() __builtin_expect(disasm_tracking, 0)
+
+/* Returns the disassembly of the instruction at pc in the current 
+ * environment, and counts an execution of it into executions */
+const char *disasm_execute(uint32_t pc, uint64_t *executions);
+
+/* Invalidates the disassembly of the instructions at address, called for 
+ * every write while tracking */
+void disasm_invalidate(uint32_t address);
+
+/* Invalidates len bytes from address, called while tracking by the handlers
+ * that write guest memory through host pointers */
+void disasm_invalidate_range(uint32_t address, uint32_t len);
+
+void disasm_free(struct tos_environment *te);
+
+#endif /* DISASM_H */
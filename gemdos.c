@@ -23,14 +23,17 @@
 #include "gemdosmem_p.h"
 #include "gemdoscon_p.h"
 #include "gemdosfile_p.h"
+#include "gemdosaio_p.h"
 
 #include <stdlib.h>
 #include <time.h>
 
 #include "tossystem.h"
 #include "cpu.h"
-#include "m68k.h"
 #include "utils.h"
+#include "m68k.h"
+#include "snapshot.h"
+#include "trace.h"
 
 #include "gemdos_p.h"
 
@@ -38,27 +41,23 @@
 
 /* Process management functions **********************************************/
 
-uint32_t GEMDOS_Pterm()
+uint32_t GEMDOS_Pterm(const uint32_t *args)
 {
-    FUNC_TRACE_ENTER_ARGS {
-        printf("    0x%x\n", peek_u16(2));
-    }
-
-    exit(peek_u16(2));
+    tos_current->exit_code = args[0];
+    halt_execution();
     return 0;
 }
         
-uint32_t GEMDOS_Pterm0()
+uint32_t GEMDOS_Pterm0(const uint32_t *args)
 {
-    FUNC_TRACE_ENTER
-
-    exit(0);
+    tos_current->exit_code = 0;
+    halt_execution();
     return 0;
 }
 
 /* Date/time functions *******************************************************/
 
-uint32_t GEMDOS_Tgetdate()
+uint32_t GEMDOS_Tgetdate(const uint32_t *args)
 {
     /*
     * 0-4     Day (1-31)
@@ -68,13 +67,9 @@ uint32_t GEMDOS_Tgetdate()
     * http://toshyp.atari.org/en/00500a.html
     */
     uint32_t res = 0;
-    time_t t;
-    struct tm *lt;
+    struct tm *lt, ltbuf;
 
-    FUNC_TRACE_ENTER
-    
-    t = time(NULL);
-    lt = localtime(&t);
+    lt = guest_time(&ltbuf);
     
     res = lt->tm_mday |
           ((lt->tm_mon+1) << 5) |
@@ -83,7 +78,7 @@ uint32_t GEMDOS_Tgetdate()
     return res;
 }
 
-uint32_t GEMDOS_Tgettime()
+uint32_t GEMDOS_Tgettime(const uint32_t *args)
 {
     /*
     * 0-4     Seconds in units of two (0-29)
@@ -93,13 +88,9 @@ uint32_t GEMDOS_Tgettime()
     * http://toshyp.atari.org/en/00500a.html
     */
     uint32_t res = 0;
-    time_t t;
-    struct tm *lt;
+    struct tm *lt, ltbuf;
     
-    FUNC_TRACE_ENTER
-
-    t = time(NULL);
-    lt = localtime(&t);
+    lt = guest_time(&ltbuf);
     
     res = (lt->tm_sec / 2) |
           (lt->tm_min << 5) |
@@ -110,15 +101,11 @@ uint32_t GEMDOS_Tgettime()
 
 /* Misc functions ************************************************************/
 
-uint32_t GEMDOS_Super()
+uint32_t GEMDOS_Super(const uint32_t *args)
 {
-    uint32_t lv0 = peek_u32(2);
+    uint32_t lv0 = args[0];
     uint32_t res = 0;
  
-    FUNC_TRACE_ENTER_ARGS {
-        printf("    0x%x\n", lv0);
-    }
-    
     if (lv0 == 0) { /* Set CPU in supervisor mode */
         res = m68k_get_reg(0, M68K_REG_A7);
         enable_supervisor_mode();
@@ -137,13 +124,29 @@ uint32_t GEMDOS_Super()
     return res;
 }    
 
-uint32_t GEMDOS_Sversion()
+uint32_t GEMDOS_Sversion(const uint32_t *args)
 {
     return 0x1500;
 }
 
+/* TOSEMU specific functions *************************************************/
+
+uint32_t GEMDOS_Psnapshot(const uint32_t *args)
+{
+    /* Returns 0 when the snapshot was taken, the resumed process returns 1 */
+    switch (save_snapshot())
+    {
+    case 0:
+        return 0;
+    case SNAPSHOT_DISABLED:
+        return GEMDOS_EINVFN;
+    default:
+        return GEMDOS_EINTRN;
+    }
+}
+
 /* Used to tag Mint-only calls that should not halt execution, but are not implemented */
-uint32_t GEMDOS_Unknown();
+uint32_t GEMDOS_Unknown(const uint32_t *args);
 
 /* Table of non-implemented GEMDOS functions */
 
@@ -239,8 +242,9 @@ uint32_t GEMDOS_Unknown();
  */
 struct GEMDOS_function {
     char *name;
-    uint32_t (*fnct)();
+    uint32_t (*fnct)(const uint32_t *args);
     uint16_t id;
+    const char *args; /* Argument signature, see decode_trap_args */
 };
 
 struct GEMDOS_function GEMDOS_functions[] = {
@@ -248,67 +252,67 @@ struct GEMDOS_function GEMDOS_functions[] = {
     {"Cauxis",      GEMDOS_Cauxis, 0x12},
     {"Cauxos",      GEMDOS_Cauxos, 0x13},
     {"Cauxout",     GEMDOS_Cauxout, 0x04},
-    {"Cconin",      GEMDOS_Cconin, 0x01},
-    {"Cconis",      GEMDOS_Cconis, 0x0B},
-    {"Cconos",      GEMDOS_Cconos, 0x10},
-    {"Cconout",     GEMDOS_Cconout, 0x02},
-    {"Cconrs",      GEMDOS_Cconrs, 0x0A},
-    {"Cconws",      GEMDOS_Cconws, 0x09},
-    {"Cnecin",      GEMDOS_Cnecin, 0x08},
+    {"Cconin",      GEMDOS_Cconin, 0x01, ""},
+    {"Cconis",      GEMDOS_Cconis, 0x0B, ""},
+    {"Cconos",      GEMDOS_Cconos, 0x10, ""},
+    {"Cconout",     GEMDOS_Cconout, 0x02, "w"},
+    {"Cconrs",      GEMDOS_Cconrs, 0x0A, "p"},
+    {"Cconws",      GEMDOS_Cconws, 0x09, "s"},
+    {"Cnecin",      GEMDOS_Cnecin, 0x08, ""},
     {"Cprnos",      GEMDOS_Cprnos, 0x11},
     {"Cprnout",     GEMDOS_Cprnout, 0x05},
-    {"Crawcin",     GEMDOS_Crawcin, 0x07},
-    {"Crawio",      GEMDOS_Crawio, 0x06},
+    {"Crawcin",     GEMDOS_Crawcin, 0x07, ""},
+    {"Crawio",      GEMDOS_Crawio, 0x06, "w"},
     {"Dclosedir",   GEMDOS_Dclosedir, 0x12B},
     {"Dcntl",       GEMDOS_Dcntl, 0x130},
-    {"Dcreate",     GEMDOS_Dcreate, 0x39},
+    {"Dcreate",     GEMDOS_Dcreate, 0x39, "s"},
     {"Ddelete",     GEMDOS_Ddelete, 0x3A},
     {"Dfree",       GEMDOS_Dfree, 0x36},
     {"Dgetcwd",     GEMDOS_Dgetcwd, 0x13B},
-    {"Dgetdrv",     GEMDOS_Dgetdrv, 0x19},
-    {"Dgetpath",    GEMDOS_Dgetpath, 0x47},
+    {"Dgetdrv",     GEMDOS_Dgetdrv, 0x19, ""},
+    {"Dgetpath",    GEMDOS_Dgetpath, 0x47, "pw"},
     {"Dlock",       GEMDOS_Dlock, 0x135},
     {"Dopendir",    GEMDOS_Dopendir, 0x128},
     {"Dpathconf",   GEMDOS_Dpathconf, 0x124},
     {"Dreaddir",    GEMDOS_Dreaddir, 0x129},
     {"Drewinddir",  GEMDOS_Drewinddir, 0x12A},
     {"Dsetdrv",     GEMDOS_Dsetdrv, 0x0E},
-    {"Dsetpath",    GEMDOS_Dsetpath, 0x3B},
-    {"Fattrib",     GEMDOS_Fattrib, 0x43},
+    {"Dsetpath",    GEMDOS_Dsetpath, 0x3B, "s"},
+    {"Fattrib",     GEMDOS_Fattrib, 0x43, "sww"},
     {"Fchmod",      GEMDOS_Fchmod, 0x132},
     {"Fchown",      GEMDOS_Fchown, 0x131},
-    {"Fclose",      GEMDOS_Fclose, 0x3E},
+    {"Fclose",      GEMDOS_Fclose, 0x3E, "w"},
     {"Fcntl",       GEMDOS_Fcntl, 0x104},
-    {"Fcreate",     GEMDOS_Fcreate, 0x3C},
-    {"Fdatime",     GEMDOS_Fdatime, 0x57},
-    {"Fdelete",     GEMDOS_Fdelete, 0x41},
+    {"Fcreate",     GEMDOS_Fcreate, 0x3C, "sw"},
+    {"Fdatime",     GEMDOS_Fdatime, 0x57, "pww"},
+    {"Fdelete",     GEMDOS_Fdelete, 0x41, "s"},
     {"Fdup",        GEMDOS_Fdup, 0x45},
     {"Fforce",      GEMDOS_Fforce, 0x46},
     {"Fgetchar",    GEMDOS_Fgetchar, 0x107},
-    {"Fgetdta",     GEMDOS_Fgetdta, 0x2F},
+    {"Fgetdta",     GEMDOS_Fgetdta, 0x2F, ""},
     {"Finstat",     GEMDOS_Finstat, 0x105},
     {"Flink",       GEMDOS_Flink, 0x12D},
     {"Flock",       GEMDOS_Flock, 0x5C},
     {"Fmidipipe",   GEMDOS_Fmidipipe, 0x126},
-    {"Fopen",       GEMDOS_Fopen, 0x3D},
+    {"Fopen",       GEMDOS_Fopen, 0x3D, "sw"},
     {"Foutstat",    GEMDOS_Foutstat, 0x106},
     {"Fpipe",       GEMDOS_Fpipe, 0x100},
     {"Fputchar",    GEMDOS_Fputchar, 0x108},
-    {"Fread",       GEMDOS_Fread, 0x3F},
+    {"Fread",       GEMDOS_Fread, 0x3F, "wlp"},
     {"Freadlink",   GEMDOS_Freadlink, 0x12F},
     {"Frename",     GEMDOS_Frename, 0x56},
-    {"Fseek",       GEMDOS_Fseek, 0x42},
+    {"Fseek",       GEMDOS_Fseek, 0x42, "lww"},
     {"Fselect",     GEMDOS_Fselect, 0x11D},
-    {"Fsetdta",     GEMDOS_Fsetdta, 0x1A},
-    {"Fsfirst",     GEMDOS_Fsfirst, 0x4E},
-    {"Fsnext",      GEMDOS_Fsnext, 0x4F},
+    {"Fsetdta",     GEMDOS_Fsetdta, 0x1A, "p"},
+    {"Fsfirst",     GEMDOS_Fsfirst, 0x4E, "sw"},
+    {"Fsnext",      GEMDOS_Fsnext, 0x4F, ""},
     {"Fsymlink",    GEMDOS_Fsymlink, 0x12E},
-    {"Fwrite",      GEMDOS_Fwrite, 0x40},
+    {"Fwrite",      GEMDOS_Fwrite, 0x40, "wlp"},
     {"Fxattr",      GEMDOS_Fxattr, 0x12C},
     {"Maddalt",     GEMDOS_Maddalt, 0x14},
-    {"Malloc",      GEMDOS_Malloc, 0x48},
-    {"Mfree",       GEMDOS_Mfree, 0x49},
-    {"Mshrink",     GEMDOS_Mshrink, 0x4A},
+    {"Malloc",      GEMDOS_Malloc, 0x48, "l"},
+    {"Mfree",       GEMDOS_Mfree, 0x49, "p"},
+    {"Mshrink",     GEMDOS_Mshrink, 0x4A, "wpl"},
     {"Mxalloc",     GEMDOS_Mxalloc, 0x44},
     {"Pause",       GEMDOS_Pause, 0x121},
     {"Pdomain",     GEMDOS_Pdomain, 0x119},
@@ -338,8 +342,8 @@ struct GEMDOS_function GEMDOS_functions[] = {
     {"Psigpending", GEMDOS_Psigpending, 0x123},
     {"Psigreturn",  GEMDOS_Psigreturn, 0x11A},
     {"Psigsetmask", GEMDOS_Psigsetmask, 0x117},
-    {"Pterm",       GEMDOS_Pterm, 0x4C},
-    {"Pterm0",      GEMDOS_Pterm0, 0x0},
+    {"Pterm",       GEMDOS_Pterm, 0x4C, "w"},
+    {"Pterm0",      GEMDOS_Pterm0, 0x0, ""},
     {"Ptermres",    GEMDOS_Ptermres, 0x31},
     {"Pumask",      GEMDOS_Pumask, 0x133},
     {"Pursval",     GEMDOS_Pursval, 0x118},
@@ -348,55 +352,106 @@ struct GEMDOS_function GEMDOS_functions[] = {
     {"Pwait3",      GEMDOS_Pwait3, 0x11C},
     {"Pwaitpid",    GEMDOS_Pwaitpid, 0x13A},
     {"Salert",      GEMDOS_Salert, 0x13C},
-    {"Super",       GEMDOS_Super, 0x20},
-    {"Sversion",    GEMDOS_Sversion, 0x30},
+    {"Super",       GEMDOS_Super, 0x20, "l"},
+    {"Sversion",    GEMDOS_Sversion, 0x30, ""},
     {"Pyield",      GEMDOS_Pyield, 0xFF},
     {"Sysconf",     GEMDOS_Sysconf, 0x122},
     {"Talarm",      GEMDOS_Talarm, 0x120},
-    {"Tgetdate",    GEMDOS_Tgetdate, 0x2A},
-    {"Tgettime",    GEMDOS_Tgettime, 0x2C},
+    {"Tgetdate",    GEMDOS_Tgetdate, 0x2A, ""},
+    {"Tgettime",    GEMDOS_Tgettime, 0x2C, ""},
     {"Tsetdate",    GEMDOS_Tsetdate, 0x2B},
     {"Tsettime",    GEMDOS_Tsettime, 0x2D},
     {"Ssystem",     GEMDOS_Ssystem, 0x154},
     {"Ffstat64",    GEMDOS_Ffstat64, 0x15D},
     {"Tgettimeofday", GEMDOS_Tgettimeofday, 0x155},
     {"Fstat64",     GEMDOS_Fstat64, 0x14B},
-    {"Psysctl",     GEMDOS_Psysctl, 0x15E}
+    {"Psysctl",     GEMDOS_Psysctl, 0x15E},
+    
+    /* TOSEMU specific functions */
+    {"Faiosubmit",  GEMDOS_Faiosubmit, 0x7E00, "p"},
+    {"Faioreap",    GEMDOS_Faioreap, 0x7E01, "pw"},
+    {"Psnapshot",   GEMDOS_Psnapshot, 0x7E02, ""}
 };
 
-void gemdos_init(struct tos_environment *te)
+int gemdos_init(struct tos_environment *te)
 {
+    te->gemdos_mem = 0;
+    te->gemdos_file = 0;
+    te->gemdos_aio = 0;
+    
     /* Memory management setup */
-    gemdos_mem_init(te);
+    if (gemdos_mem_init(te))
+        return -1;
     
     /* File management setup */
-    gemdos_file_init(te);
+    if (gemdos_file_init(te))
+        return -1;
+    
+    /* Asynchronous I/O setup */
+    if (gemdos_aio_init(te))
+        return -1;
+    
+    return 0;
+}
+
+int gemdos_snapshot(FILE *f)
+{
+    if (gemdos_mem_snapshot(f) || gemdos_file_snapshot(f))
+        return -1;
+    
+    return 0;
+}
+
+int gemdos_restore(FILE *f)
+{
+    if (gemdos_mem_restore(f) || gemdos_file_restore(f))
+        return -1;
+    
+    return 0;
 }
 
-void gemdos_free()
+void gemdos_free(struct tos_environment *te)
 {
-    gemdos_mem_free();
+    /* Outstanding requests use the handles and RAM, so they go first */
+    gemdos_aio_free(te);
+    gemdos_file_free(te);
+    gemdos_mem_free(te);
+}
+
+const char *gemdos_function_name(int i)
+{
+    if (i < 0 || i >= sizeof(GEMDOS_functions)/sizeof(struct GEMDOS_function))
+        return 0;
+    
+    return GEMDOS_functions[i].name;
 }
 
 void gemdos_trap()
 {
     uint16_t fnct = peek_u16(0);
+    uint32_t args[TRAP_ARGS_MAX];
     int i;
     
-    for(i=0; i<=sizeof(GEMDOS_functions)/sizeof(struct GEMDOS_function); ++i) {
+    for(i=0; i<sizeof(GEMDOS_functions)/sizeof(struct GEMDOS_function); ++i) {
         if (GEMDOS_functions[i].id == fnct) {
             if (GEMDOS_functions[i].fnct) {
-                uint32_t r = GEMDOS_functions[i].fnct();
-#ifdef ENABLE_GEMDOS_TRACE
-                printf("Return from %s: %d = 0x%x\n",
-                       GEMDOS_functions[i].name, r, r);
-#endif
+                uint32_t r;
+                
+                decode_trap_args(GEMDOS_functions[i].args, args);
+                if (TRACING(STATS_GEMDOS))
+                    r = trace_call(STATS_GEMDOS, GEMDOS_functions[i].name, GEMDOS_functions[i].args,
+                                   GEMDOS_functions[i].fnct, args);
+                else
+                    r = GEMDOS_functions[i].fnct(args);
                 m68k_set_reg(M68K_REG_D0, r);
             } else {
                 halt_execution();
                 printf("GEMDOS %s (0x%x) not implemented\n", GEMDOS_functions[i].name, fnct);
             }
             
+            /* A parked call is counted once it is retried and completes */
+            if (!TRAP_PARKED())
+                STATS_CALL(STATS_GEMDOS, i);
             return;
         }
     }
@@ -406,20 +461,7 @@ void gemdos_trap()
 }
 
 /* Special function implementations */
-uint32_t GEMDOS_Unknown()
+uint32_t GEMDOS_Unknown(const uint32_t *args)
 {
-    int i;
-    uint16_t fnct;
-    
-    FUNC_TRACE_ENTER_ARGS {
-        fnct = peek_u16(0);
-        printf("    func: 0x%x\n", fnct);
-
-        for(i=0; i<=sizeof(GEMDOS_functions)/sizeof(struct GEMDOS_function); ++i)
-            if (GEMDOS_functions[i].id == fnct)
-                if (GEMDOS_functions[i].fnct)
-                    printf("    %s\n", GEMDOS_functions[i].name);        
-    }
-
     return GEMDOS_EINVFN; /* http://toshyp.atari.org/en/005003.html */
 }
@@ -21,12 +21,25 @@
 #ifndef GEMDOS_H
 #define GEMDOS_H
 
+#include <stdio.h>
+
 #include "tossystem.h"
 
 /* GEMDOS functions */
 
-void gemdos_init(struct tos_environment *);
-void gemdos_free();
+/* Set up and free the GEMDOS state of an environment, init returns 0 on 
+ * success */
+int gemdos_init(struct tos_environment *);
+void gemdos_free(struct tos_environment *);
+
 void gemdos_trap();
 
+/* Returns the name of the function at index in the dispatch table, or 0 */
+const char *gemdos_function_name(int index);
+
+/* Save and restore the GEMDOS state of the current environment, return 0 on
+ * success */
+int gemdos_snapshot(FILE *f);
+int gemdos_restore(FILE *f);
+
 #endif /* GEMDOS_H */
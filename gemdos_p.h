@@ -21,9 +21,6 @@
 #ifndef GEMDOS_P_H
 #define GEMDOS_P_H
 
-#define GEMDOS_TRACE_CONTEXT
-#include "config.h"
-
 /* GEMDOS return values */
 
 #define GEMDOS_E_OK    (0)
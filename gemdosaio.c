@@ -0,0 +1,432 @@
+/*
+ * TOSEMU - an emulated environment for TOS applications
+ * Copyright (C) 2014 Johan Thelin <e8johan@gmail.com>
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#include "gemdosaio_p.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cpu.h"
+#include "memory.h"
+#include "disasm.h"
+#include "m68k.h"
+
+#include "gemdosfile_p.h"
+#include "gemdos_p.h"
+
+/* Asynchronous I/O **********************************************************/
+
+/* The guest places a ring in its own memory, laid out like this (big endian):
+ *
+ * struct aio_ring {
+ *     uint16_t entries;    * Number of sqe and cqe slots         *
+ *     uint16_t reserved;
+ *     uint32_t sq_head;    * Next sqe to consume, emulator owned *
+ *     uint32_t sq_tail;    * Next free sqe, guest owned          *
+ *     uint32_t cq_head;    * Next cqe to consume, guest owned    *
+ *     uint32_t cq_tail;    * Next free cqe, emulator owned       *
+ *     uint32_t sqes;       * Address of the sqe array            *
+ *     uint32_t cqes;       * Address of the cqe array            *
+ * };
+ *
+ * struct aio_sqe {
+ *     uint16_t opcode;     * AIO_READ or AIO_WRITE               *
+ *     uint16_t handle;     * GEMDOS file handle                  *
+ *     uint32_t buf;
+ *     uint32_t len;
+ *     int32_t  offset;     * File offset, at least 0             *
+ *     uint32_t user_data;  * Passed back untouched in the cqe    *
+ * };
+ *
+ * struct aio_cqe {
+ *     uint32_t user_data;
+ *     int32_t  result;     * Bytes transferred or GEMDOS error   *
+ * };
+ *
+ * The head and tail counters are free running, the slot used is the counter
+ * modulo entries.
+ *
+ * Faiosubmit hands all queued sqes over to a pool of host worker threads, 
+ * shared by all TOS environments of the process, and returns at once. 
+ * Faioreap moves finished requests into the completion queue, waiting for at
+ * least a given number of them. Guest memory is only accessed by the worker 
+ * threads through the request buffers, so a buffer must not be touched by 
+ * the guest until its request has been reaped.
+ *
+ * The workers use pread/pwrite at the offset of the request, the file 
+ * position shared with Fread, Fwrite and Fseek on the same handle is never 
+ * moved. A parkable environment waiting in Faioreap is parked on a pipe the 
+ * workers write to, so that it does not hold up a batch worker.
+ */
+
+#define AIO_READ  (0)
+#define AIO_WRITE (1)
+
+#define AIO_WORKERS (4)
+
+#define RING_ENTRIES (0)
+#define RING_SQ_HEAD (4)
+#define RING_SQ_TAIL (8)
+#define RING_CQ_HEAD (12)
+#define RING_CQ_TAIL (16)
+#define RING_SQES    (20)
+#define RING_CQES    (24)
+
+#define SQE_OPCODE    (0)
+#define SQE_HANDLE    (2)
+#define SQE_BUF       (4)
+#define SQE_LEN       (8)
+#define SQE_OFFSET    (12)
+#define SQE_USER_DATA (16)
+#define SQE_SIZE      (20)
+
+#define CQE_USER_DATA (0)
+#define CQE_RESULT    (4)
+#define CQE_SIZE      (8)
+
+struct aio_job;
+struct aio_job {
+    struct gemdos_aio_state *owner;
+    uint16_t opcode;
+    int fd;
+    void *buf;
+    uint32_t address; /* Of buf in the guest */
+    uint32_t len;
+    int32_t offset;
+    uint32_t user_data;
+    int32_t result;
+    
+    struct aio_job *next;
+};
+
+/* A singly linked list with a tail pointer, used as a FIFO */
+struct aio_queue {
+    struct aio_job *head, *tail;
+    int count;
+};
+
+/* Per environment completion state, protected by aio_lock */
+struct gemdos_aio_state {
+    struct aio_queue done;
+    int in_flight; /* Submitted, but not yet reaped */
+    pthread_cond_t work_done;
+    int wake[2]; /* Pipe written for each finished request, to unpark */
+};
+
+static pthread_mutex_t aio_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t aio_work_ready = PTHREAD_COND_INITIALIZER;
+
+static struct aio_queue pending;
+
+static pthread_t workers[AIO_WORKERS];
+static int workers_started;
+
+static void queue_push(struct aio_queue *q, struct aio_job *job)
+{
+    job->next = 0;
+    if (q->tail)
+        q->tail->next = job;
+    else
+        q->head = job;
+    q->tail = job;
+    q->count ++;
+}
+
+static struct aio_job *queue_pop(struct aio_queue *q)
+{
+    struct aio_job *job = q->head;
+    
+    if (job)
+    {
+        q->head = job->next;
+        if (!q->head)
+            q->tail = 0;
+        q->count --;
+    }
+    
+    return job;
+}
+
+/* Runs on a worker thread, without holding aio_lock */
+static void aio_execute(struct aio_job *job)
+{
+    ssize_t n;
+    
+    if (job->opcode == AIO_READ)
+        n = pread(job->fd, job->buf, job->len, job->offset);
+    else
+        n = pwrite(job->fd, job->buf, job->len, job->offset);
+    
+    if (n >= 0)
+        job->result = n;
+    else if (errno == EBADF)
+        job->result = GEMDOS_EIHNDL;
+    else
+        job->result = GEMDOS_EINTRN;
+}
+
+static void *aio_worker(void *arg)
+{
+    struct aio_job *job;
+    
+    pthread_mutex_lock(&aio_lock);
+    for (;;)
+    {
+        while (!pending.head)
+            pthread_cond_wait(&aio_work_ready, &aio_lock);
+        
+        job = queue_pop(&pending);
+        
+        pthread_mutex_unlock(&aio_lock);
+        aio_execute(job);
+        pthread_mutex_lock(&aio_lock);
+        
+        queue_push(&job->owner->done, job);
+        pthread_cond_signal(&job->owner->work_done);
+        
+        /* The pipe is nonblocking, when it is full the owner is woken up 
+         * already */
+        if (write(job->owner->wake[1], "", 1) < 0 && errno != EAGAIN)
+            printf("Failed to wake a parked asynchronous I/O reaper\n");
+    }
+    
+    return 0;
+}
+
+/* Called with aio_lock held */
+static int aio_start_workers()
+{
+    int i;
+    
+    if (workers_started)
+        return 0;
+    
+    for (i = 0; i < AIO_WORKERS; i++)
+    {
+        if (pthread_create(&workers[i], NULL, aio_worker, NULL))
+        {
+            printf("Failed to start asynchronous I/O worker\n");
+            break;
+        }
+        workers_started ++;
+    }
+    
+    return workers_started == 0;
+}
+
+/* Decodes a guest sqe into a job. Requests that cannot be carried out get
+ * their result set to an error code right away, valid ones are left at 0. */
+static struct aio_job *aio_prepare_job(uint32_t sqe)
+{
+    struct aio_job *job;
+    FILE *f;
+    uint32_t buf;
+    
+    job = malloc(sizeof(struct aio_job));
+    if (!job)
+        return 0;
+    memset(job, 0, sizeof(struct aio_job));
+    job->owner = tos_current->gemdos_aio;
+    
+    job->opcode = m68k_read_memory_16(sqe + SQE_OPCODE);
+    buf = job->address = m68k_read_memory_32(sqe + SQE_BUF);
+    job->len = m68k_read_memory_32(sqe + SQE_LEN);
+    job->offset = m68k_read_memory_32(sqe + SQE_OFFSET);
+    job->user_data = m68k_read_memory_32(sqe + SQE_USER_DATA);
+    f = gemdos_file_stream(m68k_read_memory_16(sqe + SQE_HANDLE));
+    
+    if (job->opcode != AIO_READ && job->opcode != AIO_WRITE)
+        job->result = GEMDOS_EINVFN;
+    else if (job->offset < 0)
+        job->result = GEMDOS_EINVAL;
+    else if (f == NULL)
+        job->result = GEMDOS_EIHNDL;
+    else if ((job->buf = tos_range_to_host_mem(buf, job->len)) == NULL)
+        job->result = GEMDOS_ERANGE;
+    else
+    {
+        /* The worker bypasses the stream, so flush anything buffered */
+        fflush(f);
+        job->fd = fileno(f);
+    }
+    
+    return job;
+}
+
+uint32_t GEMDOS_Faiosubmit(const uint32_t *args)
+{
+    uint32_t ring = args[0];
+    uint32_t head, tail, sqes;
+    uint16_t entries;
+    struct gemdos_aio_state *as = tos_current->gemdos_aio;
+    struct aio_job *job;
+    uint32_t submitted = 0;
+    int started;
+    
+    entries = m68k_read_memory_16(ring + RING_ENTRIES);
+    head = m68k_read_memory_32(ring + RING_SQ_HEAD);
+    tail = m68k_read_memory_32(ring + RING_SQ_TAIL);
+    sqes = m68k_read_memory_32(ring + RING_SQES);
+    
+    if (entries == 0 || tail - head > entries)
+        return GEMDOS_EINVAL;
+    
+    pthread_mutex_lock(&aio_lock);
+    started = aio_start_workers();
+    pthread_mutex_unlock(&aio_lock);
+    if (started)
+        return GEMDOS_EINTRN;
+    
+    while (head != tail)
+    {
+        job = aio_prepare_job(sqes + (head % entries) * SQE_SIZE);
+        if (!job)
+            break;
+        
+        pthread_mutex_lock(&aio_lock);
+        if (job->result < 0)
+            queue_push(&as->done, job);
+        else
+        {
+            queue_push(&pending, job);
+            pthread_cond_signal(&aio_work_ready);
+        }
+        as->in_flight ++;
+        pthread_mutex_unlock(&aio_lock);
+        
+        head ++;
+        submitted ++;
+    }
+    
+    m68k_write_memory_32(ring + RING_SQ_HEAD, head);
+    
+    return submitted;
+}
+
+uint32_t GEMDOS_Faioreap(const uint32_t *args)
+{
+    uint32_t ring = args[0];
+    uint16_t min_complete = args[1];
+    uint32_t cq_head, cq_tail, cqes, cqe;
+    uint16_t entries;
+    struct gemdos_aio_state *as = tos_current->gemdos_aio;
+    struct aio_job *job;
+    char c;
+    
+    entries = m68k_read_memory_16(ring + RING_ENTRIES);
+    cq_head = m68k_read_memory_32(ring + RING_CQ_HEAD);
+    cq_tail = m68k_read_memory_32(ring + RING_CQ_TAIL);
+    cqes = m68k_read_memory_32(ring + RING_CQES);
+    
+    if (entries == 0 || cq_tail - cq_head > entries)
+        return GEMDOS_EINVAL;
+    
+    pthread_mutex_lock(&aio_lock);
+    
+    /* Never wait for more requests than there are in flight */
+    if (min_complete > as->in_flight)
+        min_complete = as->in_flight;
+    if (as->done.count < min_complete)
+    {
+        /* Wakeups of the requests already done are stale, the workers 
+         * write new ones only once the lock is released */
+        while (read(as->wake[0], &c, 1) > 0)
+            ;
+        if (park_on_fd(as->wake[0]))
+        {
+            pthread_mutex_unlock(&aio_lock);
+            return 0;
+        }
+    }
+    while (as->done.count < min_complete)
+        pthread_cond_wait(&as->work_done, &aio_lock);
+    
+    while (cq_tail - cq_head < entries && (job = queue_pop(&as->done)))
+    {
+        cqe = cqes + (cq_tail % entries) * CQE_SIZE;
+        m68k_write_memory_32(cqe + CQE_USER_DATA, job->user_data);
+        m68k_write_memory_32(cqe + CQE_RESULT, job->result);
+        
+        /* The buffer was written by a worker, unseen by the memory functions */
+        if (DISASM_TRACKING() && job->opcode == AIO_READ && job->result > 0)
+            disasm_invalidate_range(job->address, job->result);
+        cq_tail ++;
+        as->in_flight --;
+        free(job);
+    }
+    
+    pthread_mutex_unlock(&aio_lock);
+    
+    m68k_write_memory_32(ring + RING_CQ_TAIL, cq_tail);
+    
+    return cq_tail - cq_head;
+}
+
+int gemdos_aio_init(struct tos_environment *te)
+{
+    struct gemdos_aio_state *as;
+    
+    as = te->gemdos_aio = malloc(sizeof(struct gemdos_aio_state));
+    if (!as)
+        return -1;
+    
+    memset(as, 0, sizeof(struct gemdos_aio_state));
+    if (pipe(as->wake))
+    {
+        free(as);
+        te->gemdos_aio = 0;
+        return -1;
+    }
+    fcntl(as->wake[0], F_SETFL, O_NONBLOCK);
+    fcntl(as->wake[1], F_SETFL, O_NONBLOCK);
+    pthread_cond_init(&as->work_done, NULL);
+    
+    return 0;
+}
+
+void gemdos_aio_free(struct tos_environment *te)
+{
+    struct gemdos_aio_state *as = te->gemdos_aio;
+    struct aio_job *job;
+    
+    if (!as)
+        return;
+    
+    /* The workers keep running for other environments, but the requests of
+     * this one must be completed before its RAM goes away */
+    pthread_mutex_lock(&aio_lock);
+    while (as->done.count < as->in_flight)
+        pthread_cond_wait(&as->work_done, &aio_lock);
+    pthread_mutex_unlock(&aio_lock);
+    
+    while ((job = queue_pop(&as->done)))
+        free(job);
+    
+    pthread_cond_destroy(&as->work_done);
+    close(as->wake[0]);
+    close(as->wake[1]);
+    free(as);
+    te->gemdos_aio = 0;
+}
@@ -0,0 +1,37 @@
+/*
+ * TOSEMU - an emulated environment for TOS applications
+ * Copyright (C) 2014 Johan Thelin <e8johan@gmail.com>
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#ifndef GEMDOSAIO_H
+#define GEMDOSAIO_H
+
+#include <stdint.h>
+
+#include "tossystem.h"
+
+/* Emulator specific GEMDOS functions for batched, asynchronous file I/O. The
+ * guest side of the interface is found in guest/tosemu_aio.h */
+
+int gemdos_aio_init(struct tos_environment *);
+void gemdos_aio_free(struct tos_environment *);
+
+uint32_t GEMDOS_Faiosubmit(const uint32_t *args);
+uint32_t GEMDOS_Faioreap(const uint32_t *args);
+
+#endif /* GEMDOSAIO_H */
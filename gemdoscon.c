@@ -25,6 +25,7 @@
 #include <termios.h>
 #include <unistd.h>
 
+#include "tossystem.h"
 #include "cpu.h"
 #include "utils.h"
 #include "m68k.h"
@@ -33,68 +34,62 @@
 
 /* Console I/O functions *****************************************************/
 
-uint32_t GEMDOS_Cconin()
+uint32_t GEMDOS_Cconin(const uint32_t *args)
 {   
-    FUNC_TRACE_ENTER
+    if (park_on_input(tos_current->con_in))
+        return 0;
     
-    return getchar() & 0xff; /* TODO no shift key status, scancode */
+    tos_current->stats.console_in++;
+    return getc(tos_current->con_in) & 0xff; /* TODO no shift key status, scancode */
 }
 
-uint32_t GEMDOS_Cnecin()
+uint32_t GEMDOS_Cnecin(const uint32_t *args)
 {   
-    FUNC_TRACE_ENTER
+    if (park_on_input(tos_current->con_in))
+        return 0;
     
     /* TODO: turn off not echo. */
-    return getchar() & 0xff; /* TODO no shift key status, scancode */
+    tos_current->stats.console_in++;
+    return getc(tos_current->con_in) & 0xff; /* TODO no shift key status, scancode */
 }
 
-uint32_t GEMDOS_Cconout()
+uint32_t GEMDOS_Cconout(const uint32_t *args)
 {
-    FUNC_TRACE_ENTER_ARGS {
-        printf("    0x%x '%c'\n", peek_u16(2), peek_u16(2)&0xff);
-    }
-
-    putchar(peek_u16(2)&0xff);
+    putc(args[0]&0xff, tos_current->con_out);
+    tos_current->stats.console_out++;
     return 0;
 }
 
-uint32_t GEMDOS_Cconis()
+uint32_t GEMDOS_Cconis(const uint32_t *args)
 {
-    FUNC_TRACE_ENTER
-
     if (console_input_available())
         return -1;
     else
         return 0;
 }
 
-uint32_t GEMDOS_Cconos()
+uint32_t GEMDOS_Cconos(const uint32_t *args)
 {
-    FUNC_TRACE_ENTER
-
     return -1; /* Always ready */
 }
 
-uint32_t GEMDOS_Cconws()
+uint32_t GEMDOS_Cconws(const uint32_t *args)
 {
-    uint32_t adr = peek_u32(2);
+    uint32_t adr = args[0];
     uint32_t res = 0;
     uint8_t ch;
 
-    FUNC_TRACE_ENTER_ARGS {
-        printf("    0x%x\n", adr);
-    }
-    
     while((ch=m68k_read_disassembler_8(adr++)))
     {
-        putchar(ch);
+        putc(ch, tos_current->con_out);
         res++;
     }
     
+    tos_current->stats.console_out += res;
     return res;
 }
 
-uint32_t GEMDOS_Cconrs()
+uint32_t GEMDOS_Cconrs(const uint32_t *args)
 {
     char buf[257]; /* Max len on ST side is 256 */
 
@@ -107,11 +102,14 @@ uint32_t GEMDOS_Cconrs()
      *   int8_t    buffer[255];   * Line buffer         *
      * } LINE;
      */
-    uint32_t lineptr = peek_u32(2);
+    uint32_t lineptr = args[0];
 
     uint8_t maxlen = m68k_read_memory_8(lineptr);
 
-    fgets(buf, maxlen, stdin);
+    if (park_on_input(tos_current->con_in))
+        return 0;
+
+    fgets(buf, maxlen, tos_current->con_in);
     int len = strlen(buf);
     if (len > 0 && buf[len-1] == '\n')
     {
@@ -128,6 +126,7 @@ uint32_t GEMDOS_Cconrs()
     }
 
     m68k_write_memory_8(lineptr+1, len);
+    tos_current->stats.console_in += len;
     char *ptr = buf;
     lineptr += 2;
     do
@@ -140,13 +139,9 @@ uint32_t GEMDOS_Cconrs()
     return 0;
 }
 
-uint32_t GEMDOS_Crawio()
+uint32_t GEMDOS_Crawio(const uint32_t *args)
 {
-    uint32_t w = peek_u16(2);
-
-    FUNC_TRACE_ENTER_ARGS {
-        printf("    0x%x\n", w);
-    }
+    uint32_t w = args[0];
 
     if (w == 0xff)
     {
@@ -156,16 +151,17 @@ uint32_t GEMDOS_Crawio()
             tcflag_t temp;
 
             /* Disable buffering */
-            tcgetattr(STDIN_FILENO, &t);
+            tcgetattr(fileno(tos_current->con_in), &t);
             temp = t.c_lflag;
             t.c_lflag &= ~ICANON;;
-            tcsetattr(STDIN_FILENO, TCSANOW, &t);
+            tcsetattr(fileno(tos_current->con_in), TCSANOW, &t);
 
-            uint32_t res = getchar() & 0xff; /* TODO no shift key status, scancode */
+            uint32_t res = getc(tos_current->con_in) & 0xff; /* TODO no shift key status, scancode */
+            tos_current->stats.console_in++;
 
             /* Restore echoing */
             t.c_lflag = temp ;
-            tcsetattr(STDIN_FILENO, TCSANOW, &t);
+            tcsetattr(fileno(tos_current->con_in), TCSANOW, &t);
 
             return res;
         }
@@ -174,33 +170,33 @@ uint32_t GEMDOS_Crawio()
     }
     else
     {
-        /* Write character to stdout */
-        putchar(w&0xff);
+        /* Write character to the console */
+        putc(w&0xff, tos_current->con_out);
+        tos_current->stats.console_out++;
     }
 
     return 0;
 }
 
-uint32_t GEMDOS_Crawcin()
+uint32_t GEMDOS_Crawcin(const uint32_t *args)
 {
-    /*FUNC_TRACE_ENTER*/
-
     if (console_input_available())
     {
         struct termios t;
         tcflag_t temp;
 
         /* Disable buffering and echoing */
-        tcgetattr(STDIN_FILENO, &t);
+        tcgetattr(fileno(tos_current->con_in), &t);
         temp = t.c_lflag;
         t.c_lflag &= ~( ICANON | ECHO );;
-        tcsetattr(STDIN_FILENO, TCSANOW, &t);
+        tcsetattr(fileno(tos_current->con_in), TCSANOW, &t);
 
-        uint32_t res = getchar() & 0xff; /* TODO no shift key status, scancode */
+        uint32_t res = getc(tos_current->con_in) & 0xff; /* TODO no shift key status, scancode */
+        tos_current->stats.console_in++;
 
         /* Restore echoing */
         t.c_lflag = temp;
-        tcsetattr(STDIN_FILENO, TCSANOW, &t);
+        tcsetattr(fileno(tos_current->con_in), TCSANOW, &t);
 
         return res;
     }
@@ -23,14 +23,14 @@
 
 #include <stdint.h>
 
-uint32_t GEMDOS_Cconin();
-uint32_t GEMDOS_Cconout();
-uint32_t GEMDOS_Cconis();
-uint32_t GEMDOS_Cconos();
-uint32_t GEMDOS_Cconws();
-uint32_t GEMDOS_Cnecin();
-uint32_t GEMDOS_Cconrs();
-uint32_t GEMDOS_Crawio();
-uint32_t GEMDOS_Crawcin();
+uint32_t GEMDOS_Cconin(const uint32_t *args);
+uint32_t GEMDOS_Cconout(const uint32_t *args);
+uint32_t GEMDOS_Cconis(const uint32_t *args);
+uint32_t GEMDOS_Cconos(const uint32_t *args);
+uint32_t GEMDOS_Cconws(const uint32_t *args);
+uint32_t GEMDOS_Cnecin(const uint32_t *args);
+uint32_t GEMDOS_Cconrs(const uint32_t *args);
+uint32_t GEMDOS_Crawio(const uint32_t *args);
+uint32_t GEMDOS_Crawcin(const uint32_t *args);
 
 #endif /* GEMDOSCON_H */
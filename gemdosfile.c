@@ -37,6 +37,7 @@
 #include "cpu.h"
 #include "utils.h"
 #include "memory.h"
+#include "disasm.h"
 
 #include "gemdos_p.h"
 
@@ -70,11 +71,20 @@ struct fhandle
 #define ATTR_DIRECTORY  0x10
 #define ATTR_ARCHIVE    0x20
 
-static struct tos_environment *tos_env;
+struct globitem;
+
+struct gemdos_file_state {
+    struct fhandle handles[HANDLES];
+    uint32_t dta_addr;
+    
+    /* Fsfirst/Fsnext search state */
+    struct globitem *globhead;
+    int sid;
+};
 
 /* File functions ************************************************************/
 
-uint32_t GEMDOS_Fseek()
+uint32_t GEMDOS_Fseek(const uint32_t *args)
 {
     /*
      * STDIN       Current File Handle 0 (standard input)
@@ -87,16 +97,12 @@ uint32_t GEMDOS_Fseek()
      *       2 =     From end of file
      */
     
-    uint16_t seekmode = peek_u16(8);
-    uint16_t handle = peek_u16(6);
-    int32_t offset = peek_s32(2);
+    uint16_t seekmode = args[2];
+    uint16_t handle = args[1];
+    int32_t offset = (int32_t)args[0];
     off_t ret;
     int whence;
     
-    FUNC_TRACE_ENTER_ARGS {
-        printf("    offset: 0x%x, handle: 0x%x, seekmode: 0x%x\n", offset, handle, seekmode);
-    }
-    
     switch (seekmode)
     {
     case 0: /* From start of file */
@@ -134,16 +140,16 @@ uint32_t GEMDOS_Fseek()
     return ret;
 }
 
-uint32_t GEMDOS_Fdatime()
+uint32_t GEMDOS_Fdatime(const uint32_t *args)
 {
     struct stat buf;
-    struct tm *lt;
+    struct tm *lt, ltbuf;
     int ret;
     uint32_t res;
     
-    uint16_t wflag = peek_u16(8);
-    uint16_t handle = peek_u16(6);
-    uint32_t ptr = peek_u32(2);
+    uint16_t wflag = args[2];
+    uint16_t handle = args[1];
+    uint32_t ptr = args[0];
     
     if (wflag == 0)
     {
@@ -153,7 +159,7 @@ uint32_t GEMDOS_Fdatime()
         
         if (!ret)
         {
-            lt = localtime(&buf.st_mtime);
+            lt = localtime_r(&buf.st_mtime, &ltbuf);
     
             res = (lt->tm_sec / 2) |
                   (lt->tm_min << 5) |
@@ -175,29 +181,21 @@ uint32_t GEMDOS_Fdatime()
         return GEMDOS_EINVAL; /* TODO we do not support setting datime, only reading */
 }
 
-uint32_t GEMDOS_Dgetdrv()
+uint32_t GEMDOS_Dgetdrv(const uint32_t *args)
 {
     return 2; /* C: */
 }
 
-uint32_t dta_addr;
-
-uint32_t GEMDOS_Fgetdta()
+uint32_t GEMDOS_Fgetdta(const uint32_t *args)
 {
-    FUNC_TRACE_ENTER
-    
-    return dta_addr;
+    return tos_current->gemdos_file->dta_addr;
 }
 
-uint32_t GEMDOS_Fsetdta()
+uint32_t GEMDOS_Fsetdta(const uint32_t *args)
 {
-    uint32_t addr = peek_u32(2);
+    uint32_t addr = args[0];
     
-    FUNC_TRACE_ENTER_ARGS {
-        printf("    0x%x\n", addr);
-    }
-        
-    dta_addr = addr;
+    tos_current->gemdos_file->dta_addr = addr;
     
     return 0;
 }
@@ -216,19 +214,14 @@ static int get_path(char *buf, uint32_t address)
     return i;
 }
 
-uint32_t GEMDOS_Dgetpath()
+uint32_t GEMDOS_Dgetpath(const uint32_t *args)
 {
-    uint32_t addr = peek_u32(2);
-    uint16_t drive = peek_u32(6);
+    uint32_t addr = args[0];
     char ubuf[PATH_MAX+1];
     int i;
 
-    FUNC_TRACE_ENTER_ARGS {
-        printf("    addr: 0x%x, drive=%d\n", addr, drive);
-    }
-
     memset(ubuf, 0, PATH_MAX+1);
-    getcwd(ubuf, sizeof ubuf);
+    strncpy(ubuf, tos_current->cwd, PATH_MAX);
 
     i=0;
     do
@@ -249,15 +242,22 @@ uint32_t GEMDOS_Dgetpath()
 static int path_from_tos(char *tp, char *up)
 {
     char tbuf[PATH_MAX+1];
-    int len;
+    int len, prefix;
     char *src, *dest;
     int prev_slash = 1;
     
     memset(tbuf, 0, PATH_MAX+1);
     
-    /* Prepend prefix */
-    strncpy(up, tos_env->base_path, PATH_MAX);
-    len = strlen(up);
+    /* Prepend prefix, relative to the working directory of the environment
+     * unless absolute */
+    up[0] = 0;
+    if (tos_current->base_path[0] != '/')
+    {
+        strncat(up, tos_current->cwd, PATH_MAX - 1);
+        strcat(up, "/");
+    }
+    strncat(up, tos_current->base_path, PATH_MAX - strlen(up));
+    len = prefix = strlen(up);
     src = tp;
     dest = up + len;
     
@@ -291,25 +291,22 @@ static int path_from_tos(char *tp, char *up)
     /* Make canonical */ /* TODO, this limits the usage of symbolic links when mixing the TOS and host file systems */
     realpath(up, tbuf);
     
-    if (tos_env->base_path[0] != 0)
+    if (tos_current->base_path[0] != 0)
     {
         /* Ensure within prefix */    
-        if (strncmp(up, tbuf, strlen(tos_env->base_path)-1))
+        if (strncmp(up, tbuf, prefix-1))
             return 0;
     }
     
     return strlen(up);
 }
 
-uint32_t GEMDOS_Dsetpath()
+uint32_t GEMDOS_Dsetpath(const uint32_t *args)
 {
-    uint32_t addr = peek_u32(2);
+    uint32_t addr = args[0];
     char buf[PATH_MAX+1];
     char ubuf[PATH_MAX+1];
-
-    FUNC_TRACE_ENTER_ARGS {
-        printf("    addr: 0x%x\n", addr);
-    }
+    struct stat sb;
 
     memset(buf, 0, PATH_MAX+1);
     memset(ubuf, 0, PATH_MAX+1);
@@ -318,22 +315,20 @@ uint32_t GEMDOS_Dsetpath()
     if (!path_from_tos(buf, ubuf))
         return GEMDOS_EFILNF;
 
-    if (chdir(ubuf))
-        perror("chdir");
+    /* The host process is shared by environments, keep the working directory
+     * per environment */
+    if (stat(ubuf, &sb) || !S_ISDIR(sb.st_mode) || !realpath(ubuf, tos_current->cwd))
+        return GEMDOS_EPTHNF;
 
     return 0;
 }
 
-uint32_t GEMDOS_Dcreate()
+uint32_t GEMDOS_Dcreate(const uint32_t *args)
 {
-    uint32_t addr = peek_u32(2);
+    uint32_t addr = args[0];
     char buf[PATH_MAX+1];
     char ubuf[PATH_MAX+1];
 
-    FUNC_TRACE_ENTER_ARGS {
-        printf("    addr: 0x%x\n", addr);
-    }
-
     memset(buf, 0, PATH_MAX+1);
     memset(ubuf, 0, PATH_MAX+1);
     get_path(buf, addr);
@@ -347,16 +342,12 @@ uint32_t GEMDOS_Dcreate()
     return 0;
 }
 
-uint32_t GEMDOS_Fdelete()
+uint32_t GEMDOS_Fdelete(const uint32_t *args)
 {
-    uint32_t addr = peek_u32(2);
+    uint32_t addr = args[0];
     char buf[PATH_MAX+1];
     char ubuf[PATH_MAX+1];
 
-    FUNC_TRACE_ENTER_ARGS {
-        printf("    addr: 0x%x\n", addr);
-    }
-
     memset(buf, 0, PATH_MAX+1);
     memset(ubuf, 0, PATH_MAX+1);
     get_path(buf, addr);
@@ -370,17 +361,16 @@ uint32_t GEMDOS_Fdelete()
     return 0;
 }
 
-static struct fhandle handles[HANDLES];
-
 static int get_handle(FILE *f)
 {
+    struct gemdos_file_state *fs = tos_current->gemdos_file;
     int i;
     for (i = 0; i < HANDLES; i++)
     {
-        if (handles[i].flags & HANDLE_ALLOCATED)
+        if (fs->handles[i].flags & HANDLE_ALLOCATED)
             continue;
-        handles[i].f = f;
-        handles[i].flags = HANDLE_ALLOCATED;
+        fs->handles[i].f = f;
+        fs->handles[i].flags = HANDLE_ALLOCATED;
         return i;
     }
     return -1;
@@ -390,7 +380,8 @@ static void make_dirs(char *path)
 {
     char *start, *end;
 
-    start = path;
+    /* Skip the root of absolute paths */
+    start = (path[0] == '/') ? path + 1 : path;
     while ((end = strchr(start, '/')) != NULL)
     {
         *end = 0;
@@ -401,17 +392,13 @@ static void make_dirs(char *path)
     }
 }
 
-uint32_t GEMDOS_Fcreate()
+uint32_t GEMDOS_Fcreate(const uint32_t *args)
 {
-    uint32_t addr = peek_u32(2);
+    uint32_t addr = args[0];
     char buf[PATH_MAX+1];
     char ubuf[PATH_MAX+1];
     int h, fd;
 
-    FUNC_TRACE_ENTER_ARGS {
-        printf("    addr: 0x%x\n", addr);
-    }
-
     memset(buf, 0, PATH_MAX+1);
     memset(ubuf, 0, PATH_MAX+1);
     get_path(buf, addr);
@@ -437,30 +424,28 @@ struct globitem {
     struct globitem *next;
 };
 
-struct globitem *globhead = 0;
-
 glob_t *gemdos_prepare_dta(int *id)
 {
-    static int sid = 42;
+    struct gemdos_file_state *fs = tos_current->gemdos_file;
     glob_t *res;
     struct globitem *item;
     
-    sid ++;
-    res = malloc(sizeof(glob_t));
+    fs->sid ++;
+    res = calloc(1, sizeof(glob_t));
     item = malloc(sizeof(struct globitem));
     
     item->g = res;
-    item->id = sid;
-    item->next = globhead;
-    globhead = item;
+    item->id = fs->sid;
+    item->next = fs->globhead;
+    fs->globhead = item;
     
-    *id = sid;
+    *id = fs->sid;
     return res;
 }
 
 glob_t *gemdos_find_dta(int *id)
 {
-    struct globitem *ptr = globhead;
+    struct globitem *ptr = tos_current->gemdos_file->globhead;
     while (ptr) {
         if (ptr->id == *id)
             return ptr->g;
@@ -473,16 +458,17 @@ glob_t *gemdos_find_dta(int *id)
 /* TODO where would be a good place to call this? Fsnext? */
 void gemdos_clear_dta(int *id)
 {
+    struct gemdos_file_state *fs = tos_current->gemdos_file;
     struct globitem *ptr, *pptr;
     
     pptr = 0;
-    ptr = globhead;
+    ptr = fs->globhead;
     while (ptr) {
         if (ptr->id == *id) {
             if (pptr)
                 pptr->next = ptr->next;
             else
-                globhead = ptr->next;
+                fs->globhead = ptr->next;
             
             globfree(ptr->g);
             free(ptr);
@@ -504,11 +490,11 @@ static uint16_t mode_to_attrib(mode_t mode)
   return attrib;
 }
 
-uint32_t GEMDOS_Fsfirst()
+uint32_t GEMDOS_Fsfirst(const uint32_t *args)
 {
     glob_t *gres;
     struct stat sres;
-    struct tm *lt;
+    struct tm *lt, ltbuf;
 
     char buf[PATH_MAX+1];
     char ubuf[PATH_MAX+1];
@@ -519,12 +505,7 @@ uint32_t GEMDOS_Fsfirst()
 
     struct DTA *dta;
 
-    uint32_t filename = peek_u32(2);
-    uint16_t attr = peek_u16(6);
-    
-    FUNC_TRACE_ENTER_ARGS {
-        printf("    filename: 0x%x, attr: 0x%x\n", filename, attr);
-    }
+    uint32_t filename = args[0];
     
     memset(buf, 0, PATH_MAX+1);
     memset(ubuf, 0, PATH_MAX+1);
@@ -541,9 +522,11 @@ uint32_t GEMDOS_Fsfirst()
     if ((i = glob(ubuf, 0, 0, gres)) == 0) {
         if (gres->gl_pathc>0) {
             stat(gres->gl_pathv[0], &sres);
-            lt = localtime(&sres.st_mtime);
+            lt = localtime_r(&sres.st_mtime, &ltbuf);
             
-            dta = (struct DTA*)(tos_mem_to_host_mem(dta_addr));
+            dta = (struct DTA*)(tos_mem_to_host_mem(tos_current->gemdos_file->dta_addr));
+            if (DISASM_TRACKING())
+                disasm_invalidate_range(tos_current->gemdos_file->dta_addr, sizeof(struct DTA));
             
             ((int*)dta)[0] = gres_id;
             ((int*)dta)[1] = 0;
@@ -599,20 +582,20 @@ uint32_t GEMDOS_Fsfirst()
     return GEMDOS_E_OK;
 }
 
-uint32_t GEMDOS_Fsnext()
+uint32_t GEMDOS_Fsnext(const uint32_t *args)
 {
     glob_t *gres;
     struct stat sres;
-    struct tm *lt;
+    struct tm *lt, ltbuf;
 
     int i;
     char *bn;
 
     struct DTA *dta;
 
-    FUNC_TRACE_ENTER
-    
-    dta = (struct DTA*)(tos_mem_to_host_mem(dta_addr));
+    dta = (struct DTA*)(tos_mem_to_host_mem(tos_current->gemdos_file->dta_addr));
+    if (DISASM_TRACKING())
+        disasm_invalidate_range(tos_current->gemdos_file->dta_addr, sizeof(struct DTA));
     gres = gemdos_find_dta((int*)dta);
     i = ((int*)dta)[1] + 1;
     ((int*)dta)[1] = i;
@@ -621,7 +604,7 @@ uint32_t GEMDOS_Fsnext()
 
     if (i < gres->gl_pathc) {
         stat(gres->gl_pathv[i], &sres);
-        lt = localtime(&sres.st_mtime);
+        lt = localtime_r(&sres.st_mtime, &ltbuf);
             
         /* 
         Bit 0:  File is write-protected
@@ -668,7 +651,7 @@ uint32_t GEMDOS_Fsnext()
     return GEMDOS_E_OK;   
 }
 
-uint32_t GEMDOS_Fopen()
+uint32_t GEMDOS_Fopen(const uint32_t *args)
 {
     char buf[PATH_MAX+1];
     char ubuf[PATH_MAX+1];
@@ -677,12 +660,8 @@ uint32_t GEMDOS_Fopen()
     FILE *f;
     int h;
 
-    uint32_t filename = peek_u32(2);
-    uint16_t mode = peek_u16(6);
-
-    FUNC_TRACE_ENTER_ARGS {
-        printf("    filename: 0x%x, mode: 0x%x\n", filename, mode);
-    }
+    uint32_t filename = args[0];
+    uint16_t mode = args[1];
 
     memset(buf, 0, PATH_MAX+1);
     memset(ubuf, 0, PATH_MAX+1);
@@ -719,20 +698,13 @@ uint32_t GEMDOS_Fopen()
     return h;
 }
 
-uint32_t GEMDOS_Fattrib()
+uint32_t GEMDOS_Fattrib(const uint32_t *args)
 {
     struct stat st;
     char buf[PATH_MAX+1];
     char ubuf[PATH_MAX+1];
 
-    uint32_t filename = peek_u32(2);
-    uint16_t wflag = peek_u16(6);
-    uint16_t attr = peek_u16(8);
-
-    FUNC_TRACE_ENTER_ARGS {
-        printf("    filename: 0x%x, wflag: %d, attr: 0x%x\n",
-               filename, wflag, attr);
-    }
+    uint32_t filename = args[0];
 
     memset(buf, 0, PATH_MAX+1);
     memset(ubuf, 0, PATH_MAX+1);
@@ -750,26 +722,36 @@ uint32_t GEMDOS_Fattrib()
 
 static int invalid_handle(uint16_t h)
 {
-    return (h >= HANDLES) || !(handles[h].flags & HANDLE_ALLOCATED);
+    return (h >= HANDLES) || !(tos_current->gemdos_file->handles[h].flags & HANDLE_ALLOCATED);
 }
 
-uint32_t GEMDOS_Fclose()
+FILE *gemdos_file_stream(uint16_t h)
 {
-    uint16_t h = peek_u16(2);
+    if (invalid_handle(h))
+        return NULL;
+
+    return tos_current->gemdos_file->handles[h].f;
+}
+
+uint32_t GEMDOS_Fclose(const uint32_t *args)
+{
+    struct gemdos_file_state *fs = tos_current->gemdos_file;
+    uint16_t h = args[0];
 
     if (invalid_handle(h))
         return GEMDOS_EIHNDL;
 
-    handles[h].flags = 0;
-    fclose(handles[h].f);
+    fs->handles[h].flags = 0;
+    fclose(fs->handles[h].f);
     return GEMDOS_E_OK;
 }
 
-uint32_t GEMDOS_Fread()
+uint32_t GEMDOS_Fread(const uint32_t *args)
 {
-    uint16_t h = peek_u16(2);
-    uint32_t len = peek_u32(4);
-    uint32_t buf = peek_u32(8);
+    struct gemdos_file_state *fs = tos_current->gemdos_file;
+    uint16_t h = args[0];
+    uint32_t len = args[1];
+    uint32_t buf = args[2];
     uint8_t *tmp;
     size_t n;
     int i;
@@ -777,12 +759,15 @@ uint32_t GEMDOS_Fread()
     if (invalid_handle(h))
         return GEMDOS_EIHNDL;
 
+    if (park_on_input(fs->handles[h].f))
+        return 0;
+
     tmp = malloc(len);
     if (tmp == NULL)
         return GEMDOS_ENSMEM;
 
-    n = fread(tmp, 1, len, handles[h].f);
-    if (ferror(handles[h].f))
+    n = fread(tmp, 1, len, fs->handles[h].f);
+    if (ferror(fs->handles[h].f))
     {
         free(tmp);
         return GEMDOS_EINTRN;
@@ -791,23 +776,21 @@ uint32_t GEMDOS_Fread()
     for (i = 0; i < n; i++)
         m68k_write_memory_8(buf+i, tmp[i]);
 
+    tos_current->stats.bytes_read += n;
     free(tmp);
     return n;
 }
 
-uint32_t GEMDOS_Fwrite()
+uint32_t GEMDOS_Fwrite(const uint32_t *args)
 {
-    uint16_t h = peek_u16(2);
-    uint32_t len = peek_u32(4);
-    uint32_t buf = peek_u32(8);
+    struct gemdos_file_state *fs = tos_current->gemdos_file;
+    uint16_t h = args[0];
+    uint32_t len = args[1];
+    uint32_t buf = args[2];
     uint8_t *tmp;
     size_t n;
     int i;
 
-    FUNC_TRACE_ENTER_ARGS {
-        printf("    handle: %d, len: %d, buf: %x\n", h, len , buf);
-    }
-
     if (invalid_handle(h))
         return GEMDOS_EIHNDL;
 
@@ -818,33 +801,164 @@ uint32_t GEMDOS_Fwrite()
     for (i = 0; i < len; i++)
         tmp[i] = m68k_read_memory_8(buf+i);
 
-    n = fwrite(tmp, 1, len, handles[h].f);
-    if (ferror(handles[h].f))
+    n = fwrite(tmp, 1, len, fs->handles[h].f);
+    if (ferror(fs->handles[h].f))
     {
         free(tmp);
         return GEMDOS_EINTRN;
     }
 
+    tos_current->stats.bytes_written += n;
     free(tmp);
     return n;
 }
 
-void gemdos_file_init(struct tos_environment *te)
+int gemdos_file_init(struct tos_environment *te)
 {
+    struct gemdos_file_state *fs;
     int i;
 
-    dta_addr = 0x000830; /* TODO this is probably cheating, points to reserved memory */
+    fs = te->gemdos_file = malloc(sizeof(struct gemdos_file_state));
+    if (!fs)
+        return -1;
+    
+    fs->globhead = 0;
+    fs->sid = 42;
+    fs->dta_addr = 0x000830; /* TODO this is probably cheating, points to reserved memory */
 
-    memset(handles, 0, sizeof handles);
+    memset(fs->handles, 0, sizeof fs->handles);
     /* Handles 0-5 are reserved. */
     for (i = 0; i < 6; i++)
-        handles[i].flags = HANDLE_ALLOCATED;
-    handles[0].f = stdin;
-    handles[1].f = stdout;
+        fs->handles[i].flags = HANDLE_ALLOCATED;
+    fs->handles[0].f = te->con_in;
+    fs->handles[1].f = te->con_out;
+    fs->handles[2].f = te->con_err;
+    
+    return 0;
+}
 
-    tos_env = te;
+/* Open handles are saved as the host path, access mode and position of the
+ * underlying file, and are reopened when restored. Search state of 
+ * Fsfirst/Fsnext is not saved. */
+int gemdos_file_snapshot(FILE *f)
+{
+    struct gemdos_file_state *fs = tos_current->gemdos_file;
+    char link[32];
+    char path[PATH_MAX];
+    int32_t i, mode;
+    int64_t pos;
+    uint16_t len;
+    ssize_t n;
+    int fd;
+    
+    if (fwrite(&fs->dta_addr, sizeof fs->dta_addr, 1, f) != 1)
+        return -1;
+    
+    /* Handles 0-5 are reserved and always map to the host's */
+    for (i = 6; i < HANDLES; i++)
+    {
+        if (!(fs->handles[i].flags & HANDLE_ALLOCATED))
+            continue;
+        
+        fflush(fs->handles[i].f);
+        fd = fileno(fs->handles[i].f);
+        snprintf(link, sizeof link, "/proc/self/fd/%d", fd);
+        n = readlink(link, path, sizeof path);
+        if (n <= 0 || n >= sizeof path)
+            return -1;
+        
+        len = n;
+        pos = lseek(fd, 0, SEEK_CUR);
+        mode = fcntl(fd, F_GETFL) & O_ACCMODE;
+        
+        if (fwrite(&i, sizeof i, 1, f) != 1 ||
+            fwrite(&mode, sizeof mode, 1, f) != 1 ||
+            fwrite(&pos, sizeof pos, 1, f) != 1 ||
+            fwrite(&len, sizeof len, 1, f) != 1 ||
+            fwrite(path, 1, len, f) != len)
+            return -1;
+    }
+    
+    i = -1;
+    if (fwrite(&i, sizeof i, 1, f) != 1)
+        return -1;
+    
+    return 0;
+}
+
+int gemdos_file_restore(FILE *f)
+{
+    struct gemdos_file_state *fs = tos_current->gemdos_file;
+    char path[PATH_MAX];
+    int32_t i, mode;
+    int64_t pos;
+    uint16_t len;
+    FILE *hf;
+    int fd;
+    
+    if (fread(&fs->dta_addr, sizeof fs->dta_addr, 1, f) != 1)
+        return -1;
+    
+    for (;;)
+    {
+        if (fread(&i, sizeof i, 1, f) != 1)
+            return -1;
+        if (i == -1)
+            break;
+        
+        if (i < 6 || i >= HANDLES ||
+            fread(&mode, sizeof mode, 1, f) != 1 ||
+            fread(&pos, sizeof pos, 1, f) != 1 ||
+            fread(&len, sizeof len, 1, f) != 1 ||
+            len >= sizeof path ||
+            fread(path, 1, len, f) != len)
+            return -1;
+        path[len] = 0;
+        
+        fd = open(path, mode);
+        if (fd < 0)
+        {
+            printf("Failed to reopen %s\n", path);
+            return -1;
+        }
+        
+        lseek(fd, pos, SEEK_SET);
+        hf = fdopen(fd, (mode == O_RDONLY) ? "r" : (mode == O_WRONLY) ? "w" : "r+");
+        if (!hf)
+        {
+            close(fd);
+            return -1;
+        }
+        
+        fs->handles[i].f = hf;
+        fs->handles[i].flags = HANDLE_ALLOCATED;
+    }
+    
+    return 0;
 }
 
-void gemdos_file_free()
+void gemdos_file_free(struct tos_environment *te)
 {
+    struct gemdos_file_state *fs = te->gemdos_file;
+    struct globitem *item;
+    int i;
+    
+    if (!fs)
+        return;
+    
+    /* Handles 0-5 are reserved and belong to the host */
+    for (i = 6; i < HANDLES; i++)
+        if (fs->handles[i].flags & HANDLE_ALLOCATED)
+            fclose(fs->handles[i].f);
+    
+    while ((item = fs->globhead))
+    {
+        fs->globhead = item->next;
+        globfree(item->g);
+        free(item->g);
+        free(item);
+    }
+    
+    free(fs);
+    te->gemdos_file = 0;
 }
@@ -22,31 +22,40 @@
 #define GEMDOSFILE_H
 
 #include <stdint.h>
+#include <stdio.h>
 
 #include "tossystem.h"
 
 /* GEMDOS functions */
 
-void gemdos_file_init(struct tos_environment *);
-void gemdos_file_free();
-
-uint32_t GEMDOS_Dgetdrv();
-
-uint32_t GEMDOS_Fseek();
-uint32_t GEMDOS_Fdatime();
-uint32_t GEMDOS_Fgetdta();
-uint32_t GEMDOS_Fsetdta();
-uint32_t GEMDOS_Fsfirst();
-uint32_t GEMDOS_Fsnext();
-uint32_t GEMDOS_Fopen();
-uint32_t GEMDOS_Fclose();
-uint32_t GEMDOS_Fread();
-uint32_t GEMDOS_Fwrite();
-uint32_t GEMDOS_Dgetpath();
-uint32_t GEMDOS_Dsetpath();
-uint32_t GEMDOS_Dcreate();
-uint32_t GEMDOS_Fcreate();
-uint32_t GEMDOS_Fdelete();
-uint32_t GEMDOS_Fattrib();
+int gemdos_file_init(struct tos_environment *);
+void gemdos_file_free(struct tos_environment *);
+
+/* Save and restore the handle table and DTA of the current environment, 
+ * return 0 on success */
+int gemdos_file_snapshot(FILE *f);
+int gemdos_file_restore(FILE *f);
+
+/* Returns the host stream of an open GEMDOS handle, or NULL if invalid */
+FILE *gemdos_file_stream(uint16_t h);
+
+uint32_t GEMDOS_Dgetdrv(const uint32_t *args);
+
+uint32_t GEMDOS_Fseek(const uint32_t *args);
+uint32_t GEMDOS_Fdatime(const uint32_t *args);
+uint32_t GEMDOS_Fgetdta(const uint32_t *args);
+uint32_t GEMDOS_Fsetdta(const uint32_t *args);
+uint32_t GEMDOS_Fsfirst(const uint32_t *args);
+uint32_t GEMDOS_Fsnext(const uint32_t *args);
+uint32_t GEMDOS_Fopen(const uint32_t *args);
+uint32_t GEMDOS_Fclose(const uint32_t *args);
+uint32_t GEMDOS_Fread(const uint32_t *args);
+uint32_t GEMDOS_Fwrite(const uint32_t *args);
+uint32_t GEMDOS_Dgetpath(const uint32_t *args);
+uint32_t GEMDOS_Dsetpath(const uint32_t *args);
+uint32_t GEMDOS_Dcreate(const uint32_t *args);
+uint32_t GEMDOS_Fcreate(const uint32_t *args);
+uint32_t GEMDOS_Fdelete(const uint32_t *args);
+uint32_t GEMDOS_Fattrib(const uint32_t *args);
 
 #endif /* GEMDOSFILE_H */
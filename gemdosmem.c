@@ -36,12 +36,32 @@ struct mem_area {
     uint32_t base, len;
     struct mem_area *next;
 };
-struct mem_area *mem_list;
-static uint32_t mem_allocatable_top;
+struct gemdos_mem_state {
+    struct mem_area *mem_list;
+    uint32_t mem_allocatable_top;
+};
+
+/* Base of the initial area, holding the basepage and the TPA. It is not 
+ * counted as heap in the statistics. */
+#define TPA_BASE (0x800)
+
+/* Updates the heap statistics of the current environment with a change of 
+ * the allocated size of area base */
+static void count_heap(uint32_t base, int64_t change)
+{
+    struct tos_stats *s = &tos_current->stats;
+    
+    if (base == TPA_BASE)
+        return;
+    
+    s->heap += change;
+    if (s->heap > s->heap_peak)
+        s->heap_peak = s->heap;
+}
 
 static struct mem_area * find_mem_area(uint32_t base, struct mem_area **prevptr)
 {
-    struct mem_area *ptr = mem_list;
+    struct mem_area *ptr = tos_current->gemdos_mem->mem_list;
     if (prevptr)
         *prevptr = 0;
     while (ptr)
@@ -56,16 +76,22 @@ static struct mem_area * find_mem_area(uint32_t base, struct mem_area **prevptr)
     return ptr;
 }
 
-uint32_t GEMDOS_Mshrink()
+static void free_mem_list(struct gemdos_mem_state *ms)
+{
+    while (ms->mem_list)
+    {
+        struct mem_area *n = ms->mem_list->next;
+        free(ms->mem_list);
+        ms->mem_list = n;
+    }
+}
+
+uint32_t GEMDOS_Mshrink(const uint32_t *args)
 {
     struct mem_area *ma;
     
-    uint32_t newsiz = peek_u32(8);
-    uint32_t block = peek_u32(4);
-    
-    FUNC_TRACE_ENTER_ARGS {
-        printf("    ns: 0x%x, b: 0x%x\n", newsiz, block);
-    }
+    uint32_t newsiz = args[2];
+    uint32_t block = args[1];
     
     ma = find_mem_area(block, 0);
     if (!ma)
@@ -73,12 +99,13 @@ uint32_t GEMDOS_Mshrink()
     if (ma->len < newsiz)
         return GEMDOS_EGSBF;
     
+    count_heap(ma->base, (int64_t)newsiz - ma->len);
     ma->len = newsiz;
 
     return 0;
 }
 
-uint32_t GEMDOS_Malloc()
+uint32_t GEMDOS_Malloc(const uint32_t *args)
 {
     /* This is the tricky mem function, stay safe if changing it.
      * 
@@ -104,10 +131,13 @@ uint32_t GEMDOS_Malloc()
      *      suitable when allocating, right now the first suitable gap is used.
      */
     
+    struct gemdos_mem_state *ms = tos_current->gemdos_mem;
     struct mem_area *prev, *ptr, *n;
     uint32_t prev_top, max_free;
     
-    int32_t newsiz = peek_s32(2);
+    int32_t newsiz = (int32_t)args[0];
+    
+    tos_current->stats.mallocs++;
     
     if (newsiz == -1)
     {
@@ -115,9 +145,9 @@ uint32_t GEMDOS_Malloc()
         
         max_free = 0;
 
-        prev = mem_list;
+        prev = ms->mem_list;
         if (prev)
-            ptr = mem_list->next;
+            ptr = ms->mem_list->next;
         else
             ptr = 0;
         
@@ -137,16 +167,16 @@ uint32_t GEMDOS_Malloc()
         else
             prev_top = 0x900;
         
-        if (max_free < mem_allocatable_top - prev_top)
-            max_free = mem_allocatable_top - prev_top;
+        if (max_free < ms->mem_allocatable_top - prev_top)
+            max_free = ms->mem_allocatable_top - prev_top;
         
         return max_free;
     }
     else
     {    
-        prev = mem_list;
+        prev = ms->mem_list;
         if (prev)
-            ptr = mem_list->next;
+            ptr = ms->mem_list->next;
         else
             ptr = 0;
         
@@ -170,6 +200,7 @@ uint32_t GEMDOS_Malloc()
                 prev->next = n;
                 
                 /* Return new base */
+                count_heap(n->base, newsiz);
                 return n->base;
             }
             
@@ -182,7 +213,7 @@ uint32_t GEMDOS_Malloc()
         else
             prev_top = 0x900;
         
-        if (newsiz < mem_allocatable_top - prev_top)
+        if (newsiz < ms->mem_allocatable_top - prev_top)
         {
             /* Large enough gap found at the end (which can be the start) */
             
@@ -198,9 +229,10 @@ uint32_t GEMDOS_Malloc()
             if (prev)
                 prev->next = n;
             else
-                mem_list = n;
+                ms->mem_list = n;
             
             /* Return new base */
+            count_heap(n->base, newsiz);
             return n->base;
         }
         
@@ -208,25 +240,24 @@ uint32_t GEMDOS_Malloc()
     }
 }
 
-uint32_t GEMDOS_Mfree()
+uint32_t GEMDOS_Mfree(const uint32_t *args)
 {
     struct mem_area *ma, *prev;
     
-    uint32_t block = peek_u32(2);
-    
-    FUNC_TRACE_ENTER_ARGS {
-        printf("    0x%x\n", block);
-    }
+    uint32_t block = args[0];
     
+    tos_current->stats.mfrees++;
     ma = find_mem_area(block, &prev);
     
     if (!ma)
         return GEMDOS_EIMBA;
     
+    count_heap(ma->base, -(int64_t)ma->len);
+    
     if (prev)
         prev->next = ma->next;
     else
-        mem_list = ma->next;
+        tos_current->gemdos_mem->mem_list = ma->next;
     
     free(ma);
     
@@ -234,26 +265,89 @@ uint32_t GEMDOS_Mfree()
 }
 
 
-void gemdos_mem_init(struct tos_environment *te)
+int gemdos_mem_init(struct tos_environment *te)
 {
-    struct mem_area *ma = malloc(sizeof(struct mem_area));
+    struct gemdos_mem_state *ms;
+    struct mem_area *ma;
+    
+    ms = te->gemdos_mem = malloc(sizeof(struct gemdos_mem_state));
+    ma = malloc(sizeof(struct mem_area));
+    if (!ms || !ma)
+        return -1;
     memset(ma, 0, sizeof(struct mem_area));
     
     /* The initial area is by convention and relates to the binary loading and
      * base page setup from tossystem */
-    ma->base = 0x800; 
+    ma->base = TPA_BASE; 
     ma->len = te->size + 0x100; /* Size + basepage */
-    mem_allocatable_top = ma->len;
+    ms->mem_allocatable_top = ma->len;
     
-    mem_list = ma;
+    ms->mem_list = ma;
+    
+    return 0;
 }
 
-void gemdos_mem_free()
+int gemdos_mem_snapshot(FILE *f)
 {
-    while (mem_list)
+    struct gemdos_mem_state *ms = tos_current->gemdos_mem;
+    struct mem_area *ptr;
+    uint32_t count = 0;
+    
+    for (ptr = ms->mem_list; ptr; ptr = ptr->next)
+        ++count;
+    
+    if (fwrite(&count, sizeof count, 1, f) != 1 ||
+        fwrite(&ms->mem_allocatable_top, sizeof ms->mem_allocatable_top, 1, f) != 1)
+        return -1;
+    
+    for (ptr = ms->mem_list; ptr; ptr = ptr->next)
     {
-        struct mem_area *n = mem_list->next;
-        free(mem_list);
-        mem_list = n;
+        if (fwrite(&ptr->base, sizeof ptr->base, 1, f) != 1 ||
+            fwrite(&ptr->len, sizeof ptr->len, 1, f) != 1)
+            return -1;
     }
+    
+    return 0;
+}
+
+int gemdos_mem_restore(FILE *f)
+{
+    struct gemdos_mem_state *ms = tos_current->gemdos_mem;
+    struct mem_area *ma, **tail;
+    uint32_t count;
+    
+    free_mem_list(ms);
+    
+    if (fread(&count, sizeof count, 1, f) != 1 ||
+        fread(&ms->mem_allocatable_top, sizeof ms->mem_allocatable_top, 1, f) != 1)
+        return -1;
+    
+    /* Rebuild the list in the saved, sorted, order */
+    tail = &ms->mem_list;
+    while (count--)
+    {
+        ma = malloc(sizeof(struct mem_area));
+        if (!ma)
+            return -1;
+        
+        ma->next = 0;
+        *tail = ma;
+        tail = &ma->next;
+        
+        if (fread(&ma->base, sizeof ma->base, 1, f) != 1 ||
+            fread(&ma->len, sizeof ma->len, 1, f) != 1)
+            return -1;
+    }
+    
+    return 0;
+}
+
+void gemdos_mem_free(struct tos_environment *te)
+{
+    if (!te->gemdos_mem)
+        return;
+    
+    free_mem_list(te->gemdos_mem);
+    free(te->gemdos_mem);
+    te->gemdos_mem = 0;
 }
@@ -24,14 +24,20 @@
 #include "tossystem.h"
 
 #include <stdint.h>
+#include <stdio.h>
 
 /* GEMDOS functions */
 
-void gemdos_mem_init(struct tos_environment *);
-void gemdos_mem_free();
+int gemdos_mem_init(struct tos_environment *);
+void gemdos_mem_free(struct tos_environment *);
 
-uint32_t GEMDOS_Mshrink();
-uint32_t GEMDOS_Malloc();
-uint32_t GEMDOS_Mfree();
+/* Save and restore the allocator state of the current environment, return 0
+ * on success */
+int gemdos_mem_snapshot(FILE *f);
+int gemdos_mem_restore(FILE *f);
+
+uint32_t GEMDOS_Mshrink(const uint32_t *args);
+uint32_t GEMDOS_Malloc(const uint32_t *args);
+uint32_t GEMDOS_Mfree(const uint32_t *args);
 
 #endif /* GEMDOSMEM_H */
@@ -0,0 +1,138 @@
+/*
+ * TOSEMU - an emulated environment for TOS applications
+ * Copyright (C) 2014 Johan Thelin <e8johan@gmail.com>
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+/* Guest side of the TOSEMU batched, asynchronous file I/O extension.
+ *
+ * Include this from programs built with the m68k-atari-mint tool chain. A 
+ * program sets up a ring, queues read and write requests on it and submits 
+ * them all using a single trap. The requests are carried out by the host in 
+ * the background, and their results are collected later on:
+ *
+ *     static struct tosemu_aio_sqe sqes[8];
+ *     static struct tosemu_aio_cqe cqes[8];
+ *     static struct tosemu_aio_ring ring;
+ *     struct tosemu_aio_cqe *cqe;
+ *
+ *     tosemu_aio_ring_init(&ring, 8, sqes, cqes);
+ *     tosemu_aio_read(&ring, handle, buf, sizeof(buf), 0, 1);
+ *     Faiosubmit(&ring);
+ *     ... compute ...
+ *     Faioreap(&ring, 1);
+ *     while ((cqe = tosemu_aio_next_cqe(&ring)))
+ *         ... cqe->user_data, cqe->result ...
+ *
+ * A buffer must not be touched until the request using it has been reaped.
+ * Requests complete in any order. Each one gives the file offset it acts on,
+ * the file position used by Fread, Fwrite and Fseek is left untouched.
+ *
+ * Faiosubmit returns the number of requests submitted, Faioreap the number 
+ * of completions waiting in the ring. Both are only available when running 
+ * in TOSEMU, anywhere else they return EINVFN.
+ */
+
+#ifndef TOSEMU_AIO_H
+#define TOSEMU_AIO_H
+
+#include <mint/osbind.h>
+
+#define TOSEMU_AIO_READ  (0)
+#define TOSEMU_AIO_WRITE (1)
+
+struct tosemu_aio_sqe {
+    unsigned short opcode;
+    unsigned short handle;
+    void *buf;
+    unsigned long len;
+    long offset;
+    unsigned long user_data;
+};
+
+struct tosemu_aio_cqe {
+    unsigned long user_data;
+    long result;
+};
+
+struct tosemu_aio_ring {
+    unsigned short entries;
+    unsigned short reserved;
+    volatile unsigned long sq_head;
+    unsigned long sq_tail;
+    unsigned long cq_head;
+    volatile unsigned long cq_tail;
+    struct tosemu_aio_sqe *sqes;
+    struct tosemu_aio_cqe *cqes;
+};
+
+#define Faiosubmit(ring) \
+    (long)trap_1_wl((short)(0x7E00),(long)(ring))
+#define Faioreap(ring,min_complete) \
+    (long)trap_1_wlw((short)(0x7E01),(long)(ring),(short)(min_complete))
+
+static inline void tosemu_aio_ring_init(struct tosemu_aio_ring *ring,
+                                        unsigned short entries,
+                                        struct tosemu_aio_sqe *sqes,
+                                        struct tosemu_aio_cqe *cqes)
+{
+    ring->entries = entries;
+    ring->reserved = 0;
+    ring->sq_head = ring->sq_tail = 0;
+    ring->cq_head = ring->cq_tail = 0;
+    ring->sqes = sqes;
+    ring->cqes = cqes;
+}
+
+/* Queues a request, returns 0 on success or -1 if the ring is full */
+static inline int tosemu_aio_queue(struct tosemu_aio_ring *ring,
+                                   unsigned short opcode, short handle,
+                                   void *buf, unsigned long len, long offset,
+                                   unsigned long user_data)
+{
+    struct tosemu_aio_sqe *sqe;
+
+    if (ring->sq_tail - ring->sq_head >= ring->entries)
+        return -1;
+
+    sqe = &ring->sqes[ring->sq_tail % ring->entries];
+    sqe->opcode = opcode;
+    sqe->handle = handle;
+    sqe->buf = buf;
+    sqe->len = len;
+    sqe->offset = offset;
+    sqe->user_data = user_data;
+    ring->sq_tail ++;
+
+    return 0;
+}
+
+#define tosemu_aio_read(ring,handle,buf,len,offset,user_data) \
+    tosemu_aio_queue(ring,TOSEMU_AIO_READ,handle,buf,len,offset,user_data)
+#define tosemu_aio_write(ring,handle,buf,len,offset,user_data) \
+    tosemu_aio_queue(ring,TOSEMU_AIO_WRITE,handle,buf,len,offset,user_data)
+
+/* Returns the next reaped completion, or NULL if there is none */
+static inline struct tosemu_aio_cqe *tosemu_aio_next_cqe(struct tosemu_aio_ring *ring)
+{
+    if (ring->cq_head == ring->cq_tail)
+        return NULL;
+
+    return &ring->cqes[ring->cq_head++ % ring->entries];
+}
+
+#endif /* TOSEMU_AIO_H */
@@ -0,0 +1,44 @@
+/*
+ * TOSEMU - an emulated environment for TOS applications
+ * Copyright (C) 2014 Johan Thelin <e8johan@gmail.com>
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+/* Guest side of the TOSEMU snapshot extension.
+ *
+ * Include this from programs built with the m68k-atari-mint tool chain. A
+ * program calls Psnapshot once its initialization is done:
+ *
+ *     ... load tables, parse configuration ...
+ *     if (Psnapshot() == 1)
+ *         ... resumed from a snapshot, re-read the command line ...
+ *     ... per-job work ...
+ *
+ * Psnapshot returns 0 when tosemu was started with --snapshot=<file> and the
+ * snapshot was written, and 1 in a process started with --restore=<file>. 
+ * Without a snapshot file, or when not running in TOSEMU, it returns EINVFN.
+ */
+
+#ifndef TOSEMU_SNAPSHOT_H
+#define TOSEMU_SNAPSHOT_H
+
+#include <mint/osbind.h>
+
+#define Psnapshot() \
+    (long)trap_1_w((short)(0x7E02))
+
+#endif /* TOSEMU_SNAPSHOT_H */
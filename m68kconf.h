@@ -127,6 +127,17 @@
 #define M68K_SET_PC_CALLBACK(A)     your_pc_changed_handler_function(A)
 
 
+/* If ON, CPU will call the supervisor changed callback every time the S flag
+ * is written, e.g. on exceptions, RTE and writes to SR.  This allows host
+ * programs to keep state that depends on the privilege level up to date
+ * instead of reading SR on every memory access.
+ */
+void memory_set_supervisor(unsigned int supervisor); /* from memory.c */
+
+#define M68K_MONITOR_SUPERVISOR     OPT_SPECIFY_HANDLER
+#define M68K_SET_SUPERVISOR_CALLBACK(A) memory_set_supervisor(A)
+
+
 /* If ON, CPU will call the instruction hook callback before every
  * instruction.
  */
@@ -138,6 +149,15 @@ void cpu_instr_callback(); /* from main.c */
 /* #define M68K_INSTRUCTION_CALLBACK() your_instruction_hook_function() */
 
 
+/* If ON, the CPU will count the clock cycles used by each instruction and
+ * m68k_execute() will run for the requested number of clock cycles.
+ * If OFF, no cycle accounting is done and m68k_execute() will run for the
+ * requested number of instructions instead.  The timeslice can still be
+ * cut short using m68k_end_timeslice().
+ */
+#define M68K_EMULATE_CYCLES         OPT_OFF
+
+
 /* If ON, the CPU will emulate the 4-byte prefetch queue of a real 68000 */
 #define M68K_EMULATE_PREFETCH       OPT_OFF
 
@@ -171,6 +191,15 @@ void cpu_instr_callback(); /* from main.c */
 #define M68K_USE_64_BIT  OPT_OFF
 
 
+/* Set to your compiler's thread local storage keyword to give each host 
+ * thread its own CPU core and disassembler state, or set it to blank for a 
+ * single core shared by the whole process. The opcode tables are shared.
+ */
+#ifndef M68K_THREAD_LOCAL
+#define M68K_THREAD_LOCAL __thread
+#endif /* M68K_THREAD_LOCAL */
+
+
 /* Set to your compiler's static inline keyword to enable it, or
  * set it to blank to disable it.
  * If you define INLINE in the makefile, it will override this value.
@@ -22,6 +22,7 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <errno.h>
 #include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -32,19 +33,41 @@
 #include "m68k.h"
 
 #include "tossystem.h"
+#include "snapshot.h"
+#include "server.h"
+#include "batch.h"
+#include "stats.h"
+#include "trace.h"
+#include "symbols.h"
+#include "profile.h"
+#include "disasm.h"
+#include "verify.h"
+#include "utils.h"
 
 int verbose;
+uint64_t verbose_first; /* Executions of each instruction traced, 0 for all */
 
 void cpu_instr_callback()
 {
-    static char buff[100];
-    static unsigned int pc;
+    const char *buff;
+    unsigned int pc;
+    const struct tos_symbol *s;
+    uint64_t executions;
+    uint32_t offset;
 
     if (verbose)
     {
         pc = m68k_get_reg(NULL, M68K_REG_PC);
-        m68k_disassemble(buff, pc, M68K_CPU_TYPE_68000);
-        printf("E %03x: %s\n", pc, buff);
+        buff = disasm_execute(pc, &executions);
+        if (verbose_first && executions > verbose_first)
+            return;
+        
+        if ((s = symbol_lookup(tos_current, pc, &offset)) && offset)
+            printf("E %03x <%s+0x%x>: %s\n", pc, s->name, offset, buff);
+        else if (s)
+            printf("E %03x <%s>: %s\n", pc, s->name, buff);
+        else
+            printf("E %03x: %s\n", pc, buff);
 #if 0 /* Dump all regs */
         printf("    D0       D1       D2       D3       D4       D5       D6       D7\n");
         printf("    %08x %08x %08x %08x %08x %08x %08x %08x\n"
@@ -71,96 +94,228 @@ void cpu_instr_callback()
     }
 }
 
-extern int keepongoing;
+/* Parses the count of --verbose-first=, returns 0 and sets verbose_first, 
+ * or -1 for a malformed value */
+static int parse_verbose_first(const char *value)
+{
+    unsigned long long n;
+    char *end;
+    
+    errno = 0;
+    n = strtoull(value, &end, 0);
+    if (errno || end == value || *end || value[0] == '-')
+        return -1;
+    
+    verbose_first = n;
+    return 0;
+}
+
+static void usage()
+{
+    printf("Usage: tosemu [-v|--verbose-first=<n>] [<limits>] [<trace>] [--profile=<file>] [--virtual-time[=<epoch>]] [--verify] [--stats] [--summary=<file>] [--snapshot=<file>] [--server=<socket>] <binary> [<args>]\n"
+           "       tosemu [-v|--verbose-first=<n>] [<limits>] [<trace>] [--profile=<file>] [--virtual-time[=<epoch>]] [--verify] [--stats] [--summary=<file>] [--server=<socket>] --restore=<file> [<args>]\n"
+           "       tosemu --client=<socket> [<args>]\n"
+           "       tosemu [<limits>] [<trace>] [--profile=<file>] [--virtual-time[=<epoch>]] [--verify] --batch=<manifest>\n\n"
+           "\t<binary> name of binary to execute\n"
+           "\t-v trace each executed instruction to stdout\n"
+           "\t--verbose-first=<n> as -v, for the first <n> executions of each instruction\n"
+           "\t--stats print statistics to stderr at exit, SIGUSR1 prints them any time\n"
+           "\t--summary=<file> write the run time and counters as JSON to <file>\n"
+           "\t<trace> log the calls of a comma separated list of dispatchers\n"
+           "\t--trace=gemdos,bios,xbios with arguments, result and host time,\n"
+           "\t  and cpu timeslices\n"
+           "\t--trace-file=<file> to <file>, the default is %s\n"
+           "\t--trace-format=text|chrome as text lines or Chrome trace events\n"
+           "\t--profile=<file> sample the call stack, written as folded stacks\n"
+           "\t--virtual-time[=<epoch>] derive the guest's time from its instructions,\n"
+           "\t  counted from <epoch> seconds since 1970, and read the console as a script\n"
+           "\t--verify check the fast paths against the simple ones, abort on a mismatch\n"
+           "\t--snapshot=<file> file written when the binary calls Psnapshot\n"
+           "\t--restore=<file> resume a snapshot, with <args> as new command line\n"
+           "\t--server=<socket> prepare the binary once and run it for each client\n"
+           "\t--client=<socket> run the binary of a server with <args>\n"
+           "\t--batch=<manifest> run the jobs of a manifest on a thread pool\n"
+           "\t<limits> stop the binary, with exit code %d, when exceeding\n"
+           "\t--max-instructions=<n> executed instructions\n"
+           "\t--max-time=<ms> wall-clock run time, or virtual time\n"
+           "\t--max-memory=<bytes> user RAM, the default is almost 16M\n"
+           "\tthe numbers take an optional k, M or G suffix\n", TRACE_FILE, TOS_LIMIT_EXIT);
+}
     
 int main(int argc, char **argv)
 {
-    int binary_file;
-    void *binary_data;
-    struct stat sb;
+    const char *path;
     struct tos_environment te;
     int argb = 1;
+    const char *snapshot = NULL;
+    const char *restore = NULL;
+    const char *server = NULL;
+    const char *summary = NULL;
+    const char *batch = NULL;
+    const char *trace_file = TRACE_FILE;
+    int trace = 0;
+    int trace_format = TRACE_TEXT;
+    const char *profile = NULL;
+    int stats = 0;
     
     verbose = 0;
+    memset(&te, 0, sizeof te);
+    stats_install_signal();
     
     /* Program usage */
     if (argc < 2)
     {
-        printf("Usage: tosemu [-v] <binary> [<args>]\n\n\t<binary> name of binary to execute\n");
+        usage();
         return -1;
     }
     
-    /* Check if we want to be verbose */
-    if (argc >= 3 && strcmp("-v", argv[1]) == 0)
+    /* Parse options */
+    while (argb < argc && argv[argb][0] == '-')
     {
-        verbose = -1;
+        if (strcmp("-v", argv[argb]) == 0)
+            verbose = -1;
+        else if (strncmp("--verbose-first=", argv[argb], 16) == 0)
+        {
+            verbose = -1;
+            if (parse_verbose_first(argv[argb] + 16))
+            {
+                usage();
+                return -1;
+            }
+        }
+        else if (strncmp("--snapshot=", argv[argb], 11) == 0)
+            snapshot = argv[argb] + 11;
+        else if (strncmp("--restore=", argv[argb], 10) == 0)
+            restore = argv[argb] + 10;
+        else if (strcmp("--stats", argv[argb]) == 0)
+            stats = stats_enabled = 1;
+        else if (strncmp("--summary=", argv[argb], 10) == 0)
+            summary = argv[argb] + 10;
+        else if (strncmp("--server=", argv[argb], 9) == 0)
+            server = argv[argb] + 9;
+        else if (strncmp("--client=", argv[argb], 9) == 0)
+            return run_client(argv[argb] + 9, argc - argb - 1, argv + argb + 1);
+        else if (strncmp("--batch=", argv[argb], 8) == 0)
+            batch = argv[argb] + 8;
+        else if (strcmp("--batch", argv[argb]) == 0 && argb + 1 < argc)
+            batch = argv[++argb];
+        else if (strncmp("--trace=", argv[argb], 8) == 0)
+        {
+            if ((trace = parse_trace_mask(argv[argb] + 8)) < 0)
+            {
+                usage();
+                return -1;
+            }
+        }
+        else if (strncmp("--trace-file=", argv[argb], 13) == 0)
+            trace_file = argv[argb] + 13;
+        else if (strcmp("--virtual-time", argv[argb]) == 0)
+            virtual_time = 1;
+        else if (strncmp("--virtual-time=", argv[argb], 15) == 0)
+        {
+            virtual_time = 1;
+            if (parse_virtual_epoch(argv[argb] + 15))
+            {
+                usage();
+                return -1;
+            }
+        }
+        else if (strcmp("--verify", argv[argb]) == 0)
+            verify_enabled = 1;
+        else if (strncmp("--profile=", argv[argb], 10) == 0)
+            profile = argv[argb] + 10;
+        else if (strncmp("--trace-format=", argv[argb], 15) == 0)
+        {
+            if ((trace_format = parse_trace_format(argv[argb] + 15)) < 0)
+            {
+                usage();
+                return -1;
+            }
+        }
+        else if (strncmp("--max-", argv[argb], 6) == 0)
+        {
+            if (parse_tos_limit(&te.limits, argv[argb] + 2))
+            {
+                usage();
+                return -1;
+            }
+        }
+        else
+        {
+            usage();
+            return -1;
+        }
         argb++;
     }
-
-    /* Open the provided file */
-    binary_file = open(argv[argb], O_RDONLY);
-    if (binary_file == -1)
-    {
-        printf("Error: failed to open '%s'\n", argv[argb]);
-        return -1;
-    }
     
-    /* Determine the file size */
-    fstat(binary_file, &sb);
+    disasm_tracking = verbose;
     
-    /* Mmap the file into memory */
-    binary_data = mmap(NULL, sb.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, binary_file, 0);
-    if (!binary_data)
+    /* In server mode the trace is opened by each job */
+    if (trace && !server && trace_open(trace_file, trace, trace_format, 0))
     {
-        printf("Error: failed to mmap '%s'\n", argv[argb]);
-        close(binary_file);
+        printf("Error: failed to open '%s'\n", trace_file);
         return -1;
     }
     
-    /* Check that the binary starts with the magix 0x601a sequence */
-    if( ((char*)binary_data)[0] != 0x60 || ((char*)binary_data)[1] != 0x1a)
+    if (batch)
     {
-        printf("Error: invalid magic in '%s'\n", argv[argb]);
-        close(binary_file);
-        return -1;
+        if (profile && profile_start(profile, 0))
+            return -1;
+        return run_batch(batch, &te.limits);
     }
     
-    argb++;
-    argv += argb;
-    argc -= argb;
+    if (restore)
+    {
+        argv += argb;
+        argc -= argb;
+        
+        /* Setup a TOS environment from the snapshot */
+        te.name = restore;
+        if (restore_snapshot(&te, restore, argc, argv))
+            return -1;
+    }
+    else
+    {
+        if (argb >= argc)
+        {
+            usage();
+            return -1;
+        }
+        
+        path = argv[argb];
+        argb++;
+        argv += argb;
+        argc -= argb;
 
-    /* Setup a TOS environment for the binary */
-    if (init_tos_environment(&te, binary_data, sb.st_size, argc, argv))
+        /* Setup a TOS environment for the binary */
+        te.name = path;
+        if (load_tos_binary(&te, path, argc, argv))
+            return -1;
+    }
+    
+    snapshot_init(&te, snapshot);
+    
+    /* In server mode, only the forked job processes continue from here */
+    if (server && run_server(&te, server))
+        return -1;
+    
+    if (trace && server && trace_open(trace_file, trace, trace_format, 1))
     {
-        printf("Error: failed to initialize TOS environment\n");
-        close(binary_file);
+        printf("Error: failed to open the trace of '%s'\n", trace_file);
         return -1;
     }
+    if (profile && profile_start(profile, server != NULL))
+        return -1;
     
-    /* Close the binary file */
-    close(binary_file);
-
-    /* Start execution */
-
-    /* TODO init cpu */
-    m68k_init();
-    m68k_set_cpu_type(M68K_CPU_TYPE_68000);
-    m68k_pulse_reset();
-
-    /* TODO is this really correct, or should it be the MSP? If so, why does that not work? */
-    m68k_set_reg(M68K_REG_ISP, 0x600); /* supervisor stack pointer */
-    m68k_set_reg(M68K_REG_USP, te.size-4); /* user stack pointer */
-    m68k_write_memory_32(te.size, 0x800); /* big endian 0x800 */
-    m68k_set_reg(M68K_REG_PC, 0x900); /* Set PC to the binary entry point */
-    disable_supervisor_mode();
-    
-    /* TODO exec */
-    while (keepongoing) {
-        m68k_execute(1);
-    }
+    run_tos_environment(&te);
+    
+    if (stats)
+        print_tos_stats(&te, stderr);
+    if (summary && write_tos_summary(&te, summary))
+        printf("Error: failed to write '%s'\n", summary);
   
     /* Clean up */
     free_tos_environment(&te);
     
-    return 0; 
+    return te.exit_code;
 }
@@ -26,9 +26,18 @@
 #include "tossystem.h"
 #include "cpu.h"
 #include "m68k.h"
+#include "symbols.h"
+#include "disasm.h"
+#include "verify.h"
 
-/* Memory area linked list head */
-static struct _memarea *head = 0;
+struct memory_state {
+    /* Memory area linked list head */
+    struct _memarea *head;
+    
+    /* Access flags granted in the current CPU mode, see memory_set_supervisor */
+    uint8_t read_mask;
+    uint8_t write_mask;
+};
 
 /* Support functions */
 static uint8_t ptr_read(struct _memarea *area, uint32_t address)
@@ -64,15 +73,50 @@ int add_fnct_memory_area(char *name, uint8_t flags, uint32_t base, uint32_t len,
     area->write = write;
     area->ptr = ptr;
     area->flags = flags;
-    area->next = head;
-    head = area;
+    area->next = tos_current->memory->head;
+    tos_current->memory->head = area;
         
     return 0;
 }
 
+static void free_areas(struct memory_state *ms)
+{
+    struct _memarea *area;
+    
+    while ((area = ms->head))
+    {
+        ms->head = area->next;
+        free(area);
+    }
+}
+
+int memory_init(struct tos_environment *te)
+{
+    te->memory = malloc(sizeof(struct memory_state));
+    if (!te->memory)
+        return 1;
+    
+    te->memory->head = 0;
+    te->memory->read_mask = MEMORY_READ;
+    te->memory->write_mask = MEMORY_WRITE;
+    
+    return 0;
+}
+
+void memory_free(struct tos_environment *te)
+{
+    if (!te->memory)
+        return;
+    
+    free_areas(te->memory);
+    free(te->memory);
+    te->memory = 0;
+}
+
 int remove_memory_area(uint32_t base)
 {
-    struct _memarea *ptr = head;
+    struct memory_state *ms = tos_current->memory;
+    struct _memarea *ptr = ms->head;
     struct _memarea *prev = 0;
     
     while (ptr)
@@ -81,13 +125,14 @@ int remove_memory_area(uint32_t base)
             if (prev)
                 prev->next = ptr->next;
             else
-                head = ptr->next;
+                ms->head = ptr->next;
             
             free(ptr);
             return 0;
         }
         
         prev = ptr;
+        ptr = ptr->next;
     }
     
     printf("Failed to remove memory area at 0x%x\n", base);
@@ -96,13 +141,34 @@ int remove_memory_area(uint32_t base)
 
 void reset_memory()
 {
-    while (head)
-        remove_memory_area(head->base);
+    free_areas(tos_current->memory);
+}
+
+/* find_memarea, counting the search into the statistics */
+static struct _memarea *find_memarea_counted(uint32_t address)
+{
+    struct tos_stats *s = &tos_current->stats;
+    struct _memarea *area = tos_current->memory->head;
+    
+    s->area_searches++;
+    while(area)
+    {
+        if (address >= area->base && address < area->base + area->len)
+            break;
+
+        area = area->next;
+        s->area_search_steps++;
+    }
+    
+    return area;
 }
 
 struct _memarea *find_memarea(uint32_t address)
 {
-    struct _memarea *area = head;
+    struct _memarea *area = tos_current->memory->head;
+    
+    if (STATS_ENABLED())
+        return find_memarea_counted(address);
     
     while(area)
     {
@@ -115,20 +181,49 @@ struct _memarea *find_memarea(uint32_t address)
     return area;
 }
 
+/* Stops the program if address is in the user RAM cut off by a memory limit,
+ * returns non-zero if it was stopped */
+static int check_memory_limit(uint32_t address)
+{
+    struct tos_environment *te = tos_current;
+    
+    if (!te->limits.memory || address < 0x900 + te->size || address >= USERRAMEND)
+        return 0;
+    
+    tos_limit_exceeded(te, "max-memory");
+    return 1;
+}
+
+/* Stops the program for an access to address, printing the address and the
+ * PC with the symbols of the program */
+static void report_fault(const char *access, uint32_t address)
+{
+    char where[64], pc[64];
+    
+    /* Only the first fault of an instruction is reported */
+    if (!tos_current->keepongoing)
+        return;
+    
+    halt_execution();
+    printf("Attempted to %s memory at %s, PC %s\n", access,
+           format_address(tos_current, where, sizeof where, address),
+           format_address(tos_current, pc, sizeof pc, m68k_get_reg(NULL, M68K_REG_PPC)));
+}
+
 void *tos_mem_to_host_mem(uint32_t address)
 {
     struct _memarea *area = find_memarea(address);
     
     if (!area) {
-        halt_execution();
-        printf("Attempted to get direct access to non-existing memory at 0x%x\n", address);
+        if (check_memory_limit(address))
+            return 0;
+        report_fault("get direct access to non-existing", address);
         return 0;
     }
     
     if (area->write != ptr_write || area->read != ptr_read)
     {
-        halt_execution();
-        printf("Attempted to get direct access to non-mapped memory at 0x%x\n", address);
+        report_fault("get direct access to non-mapped", address);
         return 0;
     }
     
@@ -136,30 +231,81 @@ void *tos_mem_to_host_mem(uint32_t address)
 }
 
 
+void *tos_host_mem_extent(uint32_t address, uint32_t *len)
+{
+    struct _memarea *area = tos_current->memory->head;
+    
+    /* Not counted in the lookup statistics, this is not a guest access */
+    while (area && (address < area->base || address >= area->base + area->len))
+        area = area->next;
+    
+    if (!area || area->write != ptr_write || area->read != ptr_read)
+        return 0;
+    
+    *len = area->len - (address - area->base);
+    return &(((uint8_t *)area->ptr)[address - area->base]);
+}
+
+/* Checks that each byte of a block handed out by tos_range_to_host_mem is 
+ * where a lookup of its own address puts it */
+static void verify_host_range(uint32_t address, uint32_t len, uint8_t *p)
+{
+    uint32_t i, rest;
+    
+    for (i = 0; i < len; ++i)
+        if (tos_host_mem_extent(address + i, &rest) != p + i)
+            verify_failed("host block at 0x%x does not hold 0x%x", address, address + i);
+}
+
+void *tos_range_to_host_mem(uint32_t address, uint32_t len)
+{
+    struct _memarea *area = find_memarea(address);
+    uint8_t *p;
+    
+    if (!area || area->write != ptr_write || area->read != ptr_read)
+        return 0;
+    
+    if (len > area->len - (address - area->base))
+        return 0;
+    
+    p = &(((uint8_t *)area->ptr)[address - area->base]);
+    if (VERIFYING())
+        verify_host_range(address, len, p);
+    return p;
+}
+
+
+/* Called by Musashi every time the S flag is written */
+void memory_set_supervisor(unsigned int supervisor)
+{
+    struct memory_state *ms = tos_current->memory;
+    
+    if (supervisor) {
+        ms->read_mask = MEMORY_READ | MEMORY_SUPERREAD;
+        ms->write_mask = MEMORY_WRITE | MEMORY_SUPERWRITE;
+    } else {
+        ms->read_mask = MEMORY_READ;
+        ms->write_mask = MEMORY_WRITE;
+    }
+}
+
 /* These are the real read/write functions */
 
 uint8_t tos_read(uint32_t address)
 {
     struct _memarea *area = find_memarea(address);
-    uint8_t mask;
     
     if (!area) {
-        halt_execution();
-        printf("Attempted to read non-existing memory at 0x%x\n", address);
+        if (check_memory_limit(address))
+            return 0;
+        report_fault("read non-existing", address);
         return 0;
     }
     
-    /* Is the CPU in supervisor mode? */
-    if (is_supervisor_mode_enabled())
-        mask = MEMORY_READ | MEMORY_SUPERREAD;
-    else
-        mask = MEMORY_READ;
-    
-    if ((area->flags & mask) != 0)
+    if ((area->flags & tos_current->memory->read_mask) != 0)
         return area->read(area, address);
     else {
-        halt_execution();
-        printf("Attempted to read non-readable memory at 0x%x\n", address);
+        report_fault("read non-readable", address);
         return 0;
     }
 }
@@ -167,25 +313,21 @@ uint8_t tos_read(uint32_t address)
 void tos_write(uint32_t address, uint8_t value)
 {
     struct _memarea *area = find_memarea(address);
-    uint8_t mask;
+    
+    if (DISASM_TRACKING())
+        disasm_invalidate(address);
     
     if (!area) {
-        halt_execution();
-        printf("Attempted to write to non-existing memory at 0x%x\n", address);
+        if (check_memory_limit(address))
+            return;
+        report_fault("write to non-existing", address);
         return;
     }
     
-    /* Is the CPU in supervisor mode? */
-    if (is_supervisor_mode_enabled())
-        mask = MEMORY_WRITE | MEMORY_SUPERWRITE;
-    else
-        mask = MEMORY_WRITE;
-    
-    if ((area->flags & mask) != 0)
+    if ((area->flags & tos_current->memory->write_mask) != 0)
         area->write(area, address, value);
     else {
-        halt_execution();
-        printf("Attempted to write to non-writeable memory at 0x%x\n", address);
+        report_fault("write to non-writeable", address);
     }
 }
 
@@ -23,6 +23,8 @@
 
 #include <stdint.h>
 
+#include "tossystem.h"
+
 /* Memory area access flags, combine with OR to your liking */
 #define MEMORY_READ       (0x01) /* Readable in all modes */ 
 #define MEMORY_WRITE      (0x02) /* Writeable in all modes */
@@ -63,6 +65,27 @@ int add_fnct_memory_area(char *name, uint8_t flags, uint32_t base, uint32_t len,
 
 void *tos_mem_to_host_mem(uint32_t address);
 
+/* Select the access flags honoured by tos_read/tos_write. Called by the CPU
+ * core whenever the S flag is written, non-zero when in supervisor mode.
+ */
+void memory_set_supervisor(unsigned int supervisor);
+
+/* Returns a host pointer to len bytes starting at address, or 0 if the range 
+ * is not completely inside a single ptr memory area. Does not halt execution.
+ */
+void *tos_range_to_host_mem(uint32_t address, uint32_t len);
+
+/* Returns a host pointer to address and sets *len to the number of bytes up 
+ * to the end of its ptr memory area, or returns 0 if there is none. Neither
+ * halts execution nor counts as a guest access.
+ */
+void *tos_host_mem_extent(uint32_t address, uint32_t *len);
+
+/* Allocate and free the memory area state of a TOS environment, the other 
+ * functions operate on the current environment */
+int memory_init(struct tos_environment *te);
+void memory_free(struct tos_environment *te);
+
 /* Remove memory areas, return 0 on success */
 int remove_memory_area(uint32_t base);
 
@@ -0,0 +1,232 @@
+/*
+ * TOSEMU - an emulated environment for TOS applications
+ * Copyright (C) 2014 Johan Thelin <e8johan@gmail.com>
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#include "profile.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <inttypes.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "m68k.h"
+#include "memory.h"
+#include "symbols.h"
+
+/* Upper bound of the length of a folded stack */
+#define STACK_MAX (PROFILE_DEPTH * 32 + 64)
+
+volatile sig_atomic_t profile_ticks;
+int profile_enabled;
+
+static const char *profile_path;
+
+/* Open addressing hash table of the sampled stacks, shared by all threads */
+struct stack_count {
+    char *stack;
+    uint64_t count;
+};
+
+static pthread_mutex_t profile_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct stack_count *stacks;
+static size_t stack_slots, stack_count;
+
+static void tick(int sig)
+{
+    profile_ticks++;
+}
+
+static uint32_t hash_stack(const char *s)
+{
+    uint32_t h = 2166136261u; /* FNV-1a */
+    
+    while (*s)
+        h = (h ^ (uint8_t)*s++) * 16777619u;
+    
+    return h;
+}
+
+/* Finds the slot of stack, which is free if stack is not in the table */
+static struct stack_count *find_stack(struct stack_count *table, size_t slots, const char *stack)
+{
+    size_t i = hash_stack(stack) & (slots - 1);
+    
+    while (table[i].stack && strcmp(table[i].stack, stack))
+        i = (i + 1) & (slots - 1);
+    
+    return &table[i];
+}
+
+static int grow_stacks(void)
+{
+    size_t slots = stack_slots ? stack_slots * 2 : 1024;
+    struct stack_count *table = calloc(slots, sizeof(struct stack_count));
+    size_t i;
+    
+    if (!table)
+        return -1;
+    
+    for (i = 0; i < stack_slots; i++)
+        if (stacks[i].stack)
+            *find_stack(table, slots, stacks[i].stack) = stacks[i];
+    
+    free(stacks);
+    stacks = table;
+    stack_slots = slots;
+    
+    return 0;
+}
+
+static void count_stack(const char *stack)
+{
+    struct stack_count *s;
+    
+    pthread_mutex_lock(&profile_lock);
+    if ((stack_count + 1) * 2 > stack_slots && grow_stacks()) {
+        pthread_mutex_unlock(&profile_lock);
+        return;
+    }
+    
+    s = find_stack(stacks, stack_slots, stack);
+    if (!s->stack) {
+        if (!(s->stack = strdup(stack))) {
+            pthread_mutex_unlock(&profile_lock);
+            return;
+        }
+        stack_count++;
+    }
+    s->count++;
+    pthread_mutex_unlock(&profile_lock);
+}
+
+static void write_profile(void)
+{
+    FILE *f;
+    size_t i;
+    
+    profile_enabled = 0;
+    f = fopen(profile_path, "w");
+    if (!f) {
+        printf("Error: failed to write '%s'\n", profile_path);
+        return;
+    }
+    
+    for (i = 0; i < stack_slots; i++)
+        if (stacks[i].stack)
+            fprintf(f, "%s %" PRIu64 "\n", stacks[i].stack, stacks[i].count);
+    
+    fclose(f);
+}
+
+int profile_start(const char *path, int job)
+{
+    struct itimerval timer;
+    struct sigaction sa;
+    char *job_path;
+    
+    memset(&sa, 0, sizeof sa);
+    sa.sa_handler = tick;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    timer.it_interval.tv_sec = 0;
+    timer.it_interval.tv_usec = 1000000 / PROFILE_HZ;
+    timer.it_value = timer.it_interval;
+    if (sigaction(SIGPROF, &sa, NULL) || setitimer(ITIMER_PROF, &timer, NULL)) {
+        printf("Error: failed to start the profiling timer\n");
+        return -1;
+    }
+    
+    /* Server jobs are forked processes sharing the option, each writes a 
+     * file of its own */
+    if (job) {
+        if (!(job_path = malloc(strlen(path) + 16)))
+            return -1;
+        sprintf(job_path, "%s.%d", path, (int)getpid());
+        path = job_path;
+    }
+    
+    /* Registered once, also when a server job starts profiling again */
+    if (!profile_path)
+        atexit(write_profile);
+    profile_path = path;
+    profile_enabled = 1;
+    
+    return 0;
+}
+
+static void append_frame(struct tos_environment *te, char *stack, size_t *len, uint32_t address)
+{
+    const struct tos_symbol *s;
+    uint32_t offset;
+    
+    if (*len >= STACK_MAX - 1)
+        return;
+    
+    if ((s = symbol_lookup(te, address, &offset)))
+        *len += snprintf(stack + *len, STACK_MAX - *len, ";%s", s->name);
+    else
+        *len += snprintf(stack + *len, STACK_MAX - *len, ";0x%x", address);
+    
+    if (*len >= STACK_MAX)
+        *len = STACK_MAX - 1;
+}
+
+void profile_poll(struct tos_environment *te)
+{
+    sig_atomic_t ticks = profile_ticks;
+    uint32_t frames[PROFILE_DEPTH];
+    uint32_t fp, next, ret;
+    char stack[STACK_MAX];
+    size_t len;
+    uint8_t *p;
+    int depth = 0, i;
+    
+    if (te->profile_ticks_seen == ticks)
+        return;
+    te->profile_ticks_seen = ticks;
+    
+    /* The PC, and the return addresses of the frames linked by A6, each 
+     * holding the A6 of its caller followed by the return address */
+    frames[depth++] = m68k_get_reg(NULL, M68K_REG_PC);
+    fp = m68k_get_reg(NULL, M68K_REG_A6);
+    while (depth < PROFILE_DEPTH && (p = tos_range_to_host_mem(fp, 8))) {
+        next = ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+        ret = ((uint32_t)p[4] << 24) | (p[5] << 16) | (p[6] << 8) | p[7];
+        
+        /* A6 need not be a frame pointer, stop at anything not looking like
+         * a call from the text segment. The stack grows downwards, so the 
+         * chain only goes up. */
+        if (ret < USERRAMSTART || ret >= USERRAMSTART + te->tsize)
+            break;
+        frames[depth++] = ret;
+        if (next <= fp)
+            break;
+        fp = next;
+    }
+    
+    /* Folded stacks list the outermost frame first */
+    len = snprintf(stack, sizeof stack, "%s", te->name ? te->name : "-");
+    for (i = depth - 1; i >= 0; i--)
+        append_frame(te, stack, &len, frames[i]);
+    
+    count_stack(stack);
+}
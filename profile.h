@@ -0,0 +1,66 @@
+/*
+ * TOSEMU - an emulated environment for TOS applications
+ * Copyright (C) 2014 Johan Thelin <e8johan@gmail.com>
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <signal.h>
+
+#include "tossystem.h"
+
+/* Sampling profiler
+ *
+ * With --profile=<file> a host interval timer, counting the CPU time of 
+ * tosemu, ticks PROFILE_HZ times a second. The timer signal only bumps a
+ * counter, which every running environment checks between timeslices. The
+ * timeslices are shortened to PROFILE_TIMESLICE instructions while 
+ * profiling, so each sample is taken within that many instructions of its
+ * tick.
+ *
+ * A sample is the PC and the return addresses of the A6 frame chain, at most 
+ * PROFILE_DEPTH frames. Samples are counted by call stack and written to the
+ * file at exit as folded stacks, one "<program>;<outer>;...;<pc> <count>" 
+ * line per stack, the input of flamegraph.pl and speedscope. The frames are
+ * symbol names if the program has a symbol table, otherwise addresses.
+ */
+
+#define PROFILE_HZ (1000)
+#define PROFILE_TIMESLICE (1000)
+#define PROFILE_DEPTH (16)
+
+/* Ticks of the timer, zero unless profiling */
+extern volatile sig_atomic_t profile_ticks;
+
+/* Non-zero while profiling */
+extern int profile_enabled;
+
+#define PROFILING() __builtin_expect(profile_enabled, 0)
+
+/* Starts profiling into the file at path, written at exit. The timer is not
+ * inherited by forked processes, so a server starts profiling in each job,
+ * with job set so that the profile is written to <path>.<pid> instead. 
+ * Returns 0 on success. */
+int profile_start(const char *path, int job);
+
+/* Samples the current environment te if the timer ticked since the last 
+ * call, called between timeslices */
+void profile_poll(struct tos_environment *te);
+
+#endif /* PROFILE_H */
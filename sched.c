@@ -0,0 +1,366 @@
+/*
+ * TOSEMU - an emulated environment for TOS applications
+ * Copyright (C) 2014 Johan Thelin <e8johan@gmail.com>
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#include "sched.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+
+/* Runnable tasks a worker queues before it stops admitting new ones */
+#define SCHED_LOCAL_TASKS (4)
+
+/* Longest time an idle worker sleeps or polls before looking for work */
+#define SCHED_IDLE_MS (10)
+
+/* A doubly linked list, the owner pops from the head and pushes to the tail,
+ * thieves take from the tail */
+struct sched_queue {
+    pthread_mutex_t lock;
+    struct sched_task *head, *tail;
+    int count;
+};
+
+struct sched;
+
+struct sched_worker {
+    struct sched *s;
+    struct sched_queue q;
+    pthread_t thread;
+    int index;
+};
+
+struct sched {
+    struct sched_task **tasks;
+    int count;
+    
+    struct sched_worker *workers;
+    int nworkers;
+    
+    /* Protected by lock */
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    int admitted;
+    int finished;
+    struct sched_queue parked; /* Only the list part is used */
+    int polling;
+};
+
+static void list_push(struct sched_queue *q, struct sched_task *t)
+{
+    t->next = 0;
+    t->prev = q->tail;
+    if (q->tail)
+        q->tail->next = t;
+    else
+        q->head = t;
+    q->tail = t;
+    q->count++;
+}
+
+static void list_remove(struct sched_queue *q, struct sched_task *t)
+{
+    if (t->prev)
+        t->prev->next = t->next;
+    else
+        q->head = t->next;
+    if (t->next)
+        t->next->prev = t->prev;
+    else
+        q->tail = t->prev;
+    q->count--;
+}
+
+/* Returns the number of tasks queued after the push */
+static int queue_push(struct sched_queue *q, struct sched_task *t)
+{
+    int count;
+    
+    pthread_mutex_lock(&q->lock);
+    list_push(q, t);
+    count = q->count;
+    pthread_mutex_unlock(&q->lock);
+    
+    return count;
+}
+
+static int queue_count(struct sched_queue *q)
+{
+    int count;
+    
+    pthread_mutex_lock(&q->lock);
+    count = q->count;
+    pthread_mutex_unlock(&q->lock);
+    
+    return count;
+}
+
+/* Takes the head, or the tail when stealing */
+static struct sched_task *queue_pop(struct sched_queue *q, int steal)
+{
+    struct sched_task *t;
+    
+    pthread_mutex_lock(&q->lock);
+    t = steal ? q->tail : q->head;
+    if (t)
+        list_remove(q, t);
+    pthread_mutex_unlock(&q->lock);
+    
+    return t;
+}
+
+static void task_finished(struct sched *s, struct sched_task *t, int status)
+{
+    t->finish(t, status);
+    
+    pthread_mutex_lock(&s->lock);
+    s->finished++;
+    if (s->finished == s->count)
+        pthread_cond_broadcast(&s->wake);
+    pthread_mutex_unlock(&s->lock);
+}
+
+/* Starts the next task not yet admitted, returns 0 if there is none */
+static struct sched_task *admit(struct sched *s)
+{
+    struct sched_task *t;
+    
+    for (;;)
+    {
+        pthread_mutex_lock(&s->lock);
+        t = (s->admitted < s->count) ? s->tasks[s->admitted++] : 0;
+        pthread_mutex_unlock(&s->lock);
+        
+        if (!t)
+            return 0;
+        
+        if (t->start(t) == 0)
+        {
+            t->te->parkable = 1;
+            return t;
+        }
+        
+        task_finished(s, t, -1);
+    }
+}
+
+static struct sched_task *steal(struct sched_worker *w)
+{
+    struct sched *s = w->s;
+    struct sched_task *t;
+    int i;
+    
+    for (i = 1; i < s->nworkers; i++)
+    {
+        t = queue_pop(&s->workers[(w->index + i) % s->nworkers].q, 1);
+        if (t)
+            return t;
+    }
+    
+    return 0;
+}
+
+/* Polls the parked tasks for up to timeout ms, moving those with input to 
+ * the worker's queue */
+static void poll_parked(struct sched_worker *w, int timeout)
+{
+    struct sched *s = w->s;
+    struct sched_task **tasks, *t;
+    struct pollfd *fds;
+    int i, n;
+    
+    /* Called with s->lock held, which is released while polling */
+    n = s->parked.count;
+    tasks = malloc(n * sizeof(struct sched_task *));
+    fds = malloc(n * sizeof(struct pollfd));
+    if (!tasks || !fds)
+    {
+        free(tasks);
+        free(fds);
+        return;
+    }
+    
+    for (i = 0, t = s->parked.head; t; t = t->next, i++)
+    {
+        tasks[i] = t;
+        fds[i].fd = t->te->wait_fd;
+        fds[i].events = POLLIN;
+        fds[i].revents = 0;
+    }
+    
+    s->polling = 1;
+    pthread_mutex_unlock(&s->lock);
+    if (poll(fds, n, timeout) < 0)
+        for (i = 0; i < n; i++)
+            fds[i].revents = 0;
+    pthread_mutex_lock(&s->lock);
+    s->polling = 0;
+    
+    /* Parked tasks are only removed by the poller, so all are still there. 
+     * Those stopped by a limit are resumed to finish. */
+    for (i = 0; i < n; i++)
+    {
+        if (!fds[i].revents && !check_tos_limits(tasks[i]->te))
+            continue;
+        
+        list_remove(&s->parked, tasks[i]);
+        tasks[i]->te->wait_fd = -1;
+        queue_push(&w->q, tasks[i]);
+    }
+    
+    free(tasks);
+    free(fds);
+}
+
+/* Waits for work to show up, returns 1 when all tasks have finished */
+static int idle(struct sched_worker *w)
+{
+    struct sched *s = w->s;
+    struct timespec ts;
+    
+    pthread_mutex_lock(&s->lock);
+    
+    if (s->finished == s->count)
+    {
+        pthread_mutex_unlock(&s->lock);
+        return 1;
+    }
+    
+    if (s->parked.count > 0 && !s->polling)
+        poll_parked(w, SCHED_IDLE_MS);
+    else
+    {
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += SCHED_IDLE_MS * 1000000L;
+        if (ts.tv_nsec >= 1000000000L)
+        {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&s->wake, &s->lock, &ts);
+    }
+    
+    pthread_mutex_unlock(&s->lock);
+    return 0;
+}
+
+static void *sched_worker(void *arg)
+{
+    struct sched_worker *w = arg;
+    struct sched *s = w->s;
+    struct sched_task *t;
+    struct tos_environment *te;
+    
+    for (;;)
+    {
+        t = 0;
+        if (queue_count(&w->q) < SCHED_LOCAL_TASKS)
+            t = admit(s);
+        if (!t)
+            t = queue_pop(&w->q, 0);
+        if (!t)
+            t = steal(w);
+        if (!t)
+        {
+            if (idle(w))
+                break;
+            continue;
+        }
+        
+        te = t->te;
+        run_tos_timeslice(te);
+        
+        /* Save the CPU state, the task may continue on another worker */
+        switch_tos_environment(NULL);
+        
+        if (!te->keepongoing)
+            task_finished(s, t, te->exit_code);
+        else if (te->wait_fd >= 0)
+        {
+            pthread_mutex_lock(&s->lock);
+            list_push(&s->parked, t);
+            pthread_mutex_unlock(&s->lock);
+        }
+        else if (queue_push(&w->q, t) > 1)
+        {
+            /* Let an idle worker steal the surplus */
+            pthread_cond_signal(&s->wake);
+        }
+        
+        /* Busy workers check the parked tasks too, so that they are not held
+         * up until a worker becomes idle */
+        if (pthread_mutex_trylock(&s->lock) == 0)
+        {
+            if (s->parked.count > 0 && !s->polling)
+                poll_parked(w, 0);
+            pthread_mutex_unlock(&s->lock);
+        }
+    }
+    
+    return 0;
+}
+
+void sched_run(struct sched_task **tasks, int count, int workers)
+{
+    struct sched s;
+    int i, started;
+    
+    memset(&s, 0, sizeof s);
+    s.tasks = tasks;
+    s.count = count;
+    pthread_mutex_init(&s.lock, NULL);
+    pthread_cond_init(&s.wake, NULL);
+    
+    if (workers > count)
+        workers = count;
+    if (workers < 1)
+        workers = 1;
+    
+    /* Workers that fail to start just leave an empty queue to steal from */
+    s.workers = calloc(workers, sizeof(struct sched_worker));
+    if (!s.workers)
+        return;
+    s.nworkers = workers;
+    for (i = 0; i < workers; i++)
+    {
+        s.workers[i].s = &s;
+        s.workers[i].index = i;
+        pthread_mutex_init(&s.workers[i].q.lock, NULL);
+    }
+    
+    for (started = 0; started < workers; started++)
+        if (pthread_create(&s.workers[started].thread, NULL, sched_worker, &s.workers[started]))
+            break;
+    
+    if (started == 0)
+        sched_worker(&s.workers[0]);
+    
+    for (i = 0; i < started; i++)
+        pthread_join(s.workers[i].thread, NULL);
+    
+    for (i = 0; i < workers; i++)
+        pthread_mutex_destroy(&s.workers[i].q.lock);
+    free(s.workers);
+    pthread_cond_destroy(&s.wake);
+    pthread_mutex_destroy(&s.lock);
+}
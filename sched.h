@@ -0,0 +1,58 @@
+/*
+ * TOSEMU - an emulated environment for TOS applications
+ * Copyright (C) 2014 Johan Thelin <e8johan@gmail.com>
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#ifndef SCHED_H
+#define SCHED_H
+
+#include "tossystem.h"
+
+/* Time-sliced scheduler for many TOS environments
+ *
+ * Every worker thread keeps a queue of runnable tasks, which it runs round 
+ * robin one timeslice at a time. A worker admits new tasks while its queue 
+ * is short, and steals from the back of the queues of other workers when it
+ * runs out of work. Tasks waiting for input, see park_on_input, are parked 
+ * until their host fd becomes readable, which workers poll between timeslices
+ * and while idle.
+ */
+
+struct sched_task;
+struct sched_task {
+    struct tos_environment *te;
+    
+    /* Sets up te on the worker before the first timeslice, returns 0 on 
+     * success */
+    int (*start)(struct sched_task *task);
+    
+    /* Called on the worker when the program has terminated with status, or
+     * with -1 if it could not be started. te is left for the callback to 
+     * free. */
+    void (*finish)(struct sched_task *task, int status);
+    
+    void *data; /* Free for use by the callbacks */
+    
+    struct sched_task *prev, *next; /* Private to the scheduler */
+};
+
+/* Runs the tasks, in order of admission, on up to workers threads and 
+ * returns when all have finished */
+void sched_run(struct sched_task **tasks, int count, int workers);
+
+#endif /* SCHED_H */
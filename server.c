@@ -0,0 +1,394 @@
+/*
+ * TOSEMU - an emulated environment for TOS applications
+ * Copyright (C) 2014 Johan Thelin <e8johan@gmail.com>
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#include "server.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <linux/limits.h>
+
+/* Number of times, 10ms apart, the client retries to connect to a server
+ * that is still starting up */
+#define CONNECT_RETRIES (100)
+
+/* Seconds the server waits for the request of a connected client */
+#define REQUEST_TIMEOUT (5)
+
+/* Seconds the server waits before accepting again after an error */
+#define ACCEPT_BACKOFF (1)
+
+static int make_address(struct sockaddr_un *addr, const char *path)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path))
+    {
+        printf("Error: socket path '%s' is too long\n", path);
+        return -1;
+    }
+    strcpy(addr->sun_path, path);
+    
+    return 0;
+}
+
+static int read_all(int fd, void *buf, size_t len)
+{
+    ssize_t n;
+    
+    while (len > 0)
+    {
+        n = read(fd, buf, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        buf = (char *)buf + n;
+        len -= n;
+    }
+    
+    return 0;
+}
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+    ssize_t n;
+    
+    while (len > 0)
+    {
+        n = write(fd, buf, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        buf = (const char *)buf + n;
+        len -= n;
+    }
+    
+    return 0;
+}
+
+/* Server side */
+
+static int job_connection;
+
+/* Flushes the guest output and reports the exit status of the job */
+static void report_status(int status, void *arg)
+{
+    int32_t result = status;
+    
+    (void)arg;
+    fflush(NULL);
+    write_all(job_connection, &result, sizeof(result));
+    close(job_connection);
+}
+
+/* Closes the fds passed along with a rejected request */
+static void close_passed_fds(struct msghdr *msg)
+{
+    struct cmsghdr *cmsg;
+    int *fds;
+    size_t i, n;
+    
+    for (cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg))
+    {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+            continue;
+        fds = (int *)CMSG_DATA(cmsg);
+        n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (i = 0; i < n; i++)
+            close(fds[i]);
+    }
+}
+
+/* Receives a request, returns the payload in *data and the stdio fds in fds */
+static int receive_request(int conn, struct server_request *req, char **data, int *fds)
+{
+    char control[CMSG_SPACE(3 * sizeof(int))];
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    ssize_t n;
+    
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = req;
+    iov.iov_len = sizeof(*req);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    
+    do
+        n = recvmsg(conn, &msg, MSG_WAITALL);
+    while (n < 0 && errno == EINTR);
+    
+    /* The control buffer is only valid when something was received */
+    if (n <= 0)
+        return -1;
+    
+    cmsg = CMSG_FIRSTHDR(&msg);
+    if ((msg.msg_flags & MSG_CTRUNC) || cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET
+        || cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(3 * sizeof(int)))
+    {
+        close_passed_fds(&msg);
+        return -1;
+    }
+    memcpy(fds, CMSG_DATA(cmsg), 3 * sizeof(int));
+    
+    if (n != sizeof(*req) || req->len == 0 || req->len > SERVER_MAX_REQUEST)
+        goto fail;
+    
+    *data = malloc(req->len);
+    if (*data == NULL)
+        goto fail;
+    if (read_all(conn, *data, req->len) || (*data)[req->len - 1] != 0)
+    {
+        free(*data);
+        goto fail;
+    }
+    
+    return 0;
+    
+fail:
+    close(fds[0]);
+    close(fds[1]);
+    close(fds[2]);
+    return -1;
+}
+
+/* Applies a request to the forked child */
+static int start_job(struct tos_environment *te, const struct server_request *req,
+                     char *data, const int *fds)
+{
+    char **argv;
+    char *p = data, *end = data + req->len;
+    uint32_t i;
+    
+    /* Split the payload into the working directory and the arguments */
+    argv = malloc((req->argc + 1) * sizeof(char *));
+    if (argv == NULL)
+        return -1;
+    p += strlen(p) + 1;
+    for (i = 0; i < req->argc; i++)
+    {
+        if (p >= end)
+            return -1;
+        argv[i] = p;
+        p += strlen(p) + 1;
+    }
+    
+    if (chdir(data) || !getcwd(te->cwd, sizeof(te->cwd)))
+        return -1;
+    
+    for (i = 0; i < 3; i++)
+    {
+        if (dup2(fds[i], i) < 0)
+            return -1;
+        close(fds[i]);
+    }
+    
+    set_tos_cmdline(te, req->argc, argv);
+    
+    return 0;
+}
+
+int run_server(struct tos_environment *te, const char *path)
+{
+    struct sockaddr_un addr;
+    struct server_request req;
+    char *data;
+    int fds[3];
+    int sock, conn;
+    struct timeval timeout = { REQUEST_TIMEOUT, 0 };
+    struct stat sb;
+    pid_t pid;
+    
+    if (make_address(&addr, path))
+        return -1;
+    
+    sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0)
+    {
+        printf("Error: failed to create socket\n");
+        return -1;
+    }
+    
+    /* Replace the socket of an earlier server, but never another file */
+    if (lstat(path, &sb) == 0 && (!S_ISSOCK(sb.st_mode) || unlink(path)))
+    {
+        printf("Error: failed to listen on '%s'\n", path);
+        close(sock);
+        return -1;
+    }
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) || listen(sock, SOMAXCONN))
+    {
+        printf("Error: failed to listen on '%s'\n", path);
+        close(sock);
+        return -1;
+    }
+    
+    /* Let finished jobs be reaped automatically */
+    signal(SIGCHLD, SIG_IGN);
+    
+    /* Nothing buffered may be inherited and written by the children */
+    fflush(NULL);
+    
+    for (;;)
+    {
+        conn = accept(sock, NULL, NULL);
+        if (conn < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            
+            /* Such as running out of file descriptors, give the jobs time
+             * to finish and release some */
+            printf("Error: failed to accept a connection on '%s'\n", path);
+            fflush(stdout);
+            sleep(ACCEPT_BACKOFF);
+            continue;
+        }
+        
+        /* Clients are served one at a time, a silent one must not block 
+         * the others */
+        setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        
+        if (receive_request(conn, &req, &data, fds))
+        {
+            close(conn);
+            continue;
+        }
+        
+        pid = fork();
+        if (pid == 0)
+        {
+            signal(SIGCHLD, SIG_DFL);
+            close(sock);
+            
+            job_connection = conn;
+            if (start_job(te, &req, data, fds))
+                _exit(255);
+            on_exit(report_status, NULL);
+            
+            return 0;
+        }
+        
+        free(data);
+        close(fds[0]);
+        close(fds[1]);
+        close(fds[2]);
+        close(conn);
+    }
+}
+
+/* Client side */
+
+int run_client(const char *path, int argc, char **argv)
+{
+    char control[CMSG_SPACE(3 * sizeof(int))];
+    char cwd[PATH_MAX];
+    struct sockaddr_un addr;
+    struct server_request req;
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    int fds[3] = { 0, 1, 2 };
+    int32_t status;
+    char *data, *p;
+    int sock, i, retries;
+    
+    if (make_address(&addr, path))
+        return 255;
+    
+    if (getcwd(cwd, sizeof(cwd)) == NULL)
+    {
+        printf("Error: failed to get working directory\n");
+        return 255;
+    }
+    
+    /* Build the payload */
+    req.argc = argc;
+    req.len = strlen(cwd) + 1;
+    for (i = 0; i < argc; i++)
+        req.len += strlen(argv[i]) + 1;
+    if (req.len > SERVER_MAX_REQUEST)
+    {
+        printf("Error: command line too long\n");
+        return 255;
+    }
+    data = malloc(req.len);
+    if (data == NULL)
+        return 255;
+    p = stpcpy(data, cwd) + 1;
+    for (i = 0; i < argc; i++)
+        p = stpcpy(p, argv[i]) + 1;
+    
+    /* Connect, waiting for a server that is still starting up */
+    sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0)
+    {
+        printf("Error: failed to create socket\n");
+        return 255;
+    }
+    for (retries = 0; connect(sock, (struct sockaddr *)&addr, sizeof(addr)); retries++)
+    {
+        if ((errno != ENOENT && errno != ECONNREFUSED) || retries == CONNECT_RETRIES)
+        {
+            printf("Error: failed to connect to '%s'\n", path);
+            return 255;
+        }
+        usleep(10000);
+    }
+    
+    /* Send the request header along with the stdio fds, then the payload */
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = &req;
+    iov.iov_len = sizeof(req);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    
+    if (sendmsg(sock, &msg, 0) != sizeof(req) || write_all(sock, data, req.len))
+    {
+        printf("Error: failed to send request to '%s'\n", path);
+        return 255;
+    }
+    free(data);
+    
+    /* Wait for the job to finish */
+    if (read_all(sock, &status, sizeof(status)))
+        status = 255;
+    close(sock);
+    
+    return status;
+}
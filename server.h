@@ -0,0 +1,56 @@
+/*
+ * TOSEMU - an emulated environment for TOS applications
+ * Copyright (C) 2014 Johan Thelin <e8johan@gmail.com>
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "tossystem.h"
+
+/* Fork-server mode
+ *
+ * The server loads and prepares a binary once, then listens for jobs on a 
+ * unix domain socket. Each job carries the command line, the working 
+ * directory and the client's stdin, stdout and stderr. The server forks a 
+ * copy-on-write child per job that runs the prepared program with the job's 
+ * command line and stdio, and reports its exit status back to the client.
+ *
+ * Request: struct server_request with the three stdio fds attached as 
+ *          SCM_RIGHTS, followed by len bytes holding the working directory 
+ *          and argc arguments, each NUL-terminated
+ * Reply:   int32_t exit status, the connection is closed without a reply if
+ *          the child dies from a signal
+ */
+
+#define SERVER_MAX_REQUEST (0x10000)
+
+struct server_request {
+    uint32_t argc;
+    uint32_t len;
+};
+
+/* Listens on the socket at path and serves jobs. Only returns in a forked 
+ * child, with 0 once the environment has been set up for the job, or -1 if
+ * the socket cannot be created. */
+int run_server(struct tos_environment *te, const char *path);
+
+/* Runs a job with argv on the server at path and returns its exit status */
+int run_client(const char *path, int argc, char **argv);
+
+#endif /* SERVER_H */
@@ -0,0 +1,179 @@
+/*
+ * TOSEMU - an emulated environment for TOS applications
+ * Copyright (C) 2014 Johan Thelin <e8johan@gmail.com>
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#include "snapshot.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <linux/limits.h>
+
+#include "gemdos.h"
+#include "m68k.h"
+
+/* Snapshot file layout:
+ *
+ * 0x00000 snapshot_header
+ *         GEMDOS state, see gemdos_snapshot
+ * 0x10000 Guest RAM from 0x0 up to USERRAMEND, all-zero pages are left as 
+ *         holes
+ *
+ * Everything is stored in host endianess, a snapshot is only valid for the 
+ * tosemu binary and host that created it.
+ */
+#define SNAPSHOT_MAGIC "TOSSNAP1"
+#define SNAPSHOT_RAM_OFFSET (0x10000)
+#define SNAPSHOT_PAGE (0x1000)
+
+/* Registers in restore order, SR first as it selects the active stack */
+static const int snapshot_regs[] = {
+    M68K_REG_SR, M68K_REG_USP, M68K_REG_ISP, M68K_REG_MSP,
+    M68K_REG_D0, M68K_REG_D1, M68K_REG_D2, M68K_REG_D3,
+    M68K_REG_D4, M68K_REG_D5, M68K_REG_D6, M68K_REG_D7,
+    M68K_REG_A0, M68K_REG_A1, M68K_REG_A2, M68K_REG_A3,
+    M68K_REG_A4, M68K_REG_A5, M68K_REG_A6, M68K_REG_A7,
+    M68K_REG_SFC, M68K_REG_DFC, M68K_REG_VBR,
+    M68K_REG_PC
+};
+#define SNAPSHOT_REGS (sizeof(snapshot_regs)/sizeof(snapshot_regs[0]))
+
+struct snapshot_header {
+    char magic[8];
+    uint32_t regs[SNAPSHOT_REGS];
+    uint32_t tsize, dsize, bsize, ssize, prgflags;
+};
+
+void snapshot_init(struct tos_environment *te, const char *path)
+{
+    te->snapshot_path = path;
+}
+
+static int is_zero_page(const uint8_t *p)
+{
+    static const uint8_t zero[SNAPSHOT_PAGE];
+    return memcmp(p, zero, SNAPSHOT_PAGE) == 0;
+}
+
+int save_snapshot()
+{
+    struct tos_environment *te = tos_current;
+    struct snapshot_header header;
+    char tmp[PATH_MAX];
+    uint32_t address;
+    FILE *f;
+    int fd, i, ok;
+    
+    if (!te->snapshot_path)
+        return SNAPSHOT_DISABLED;
+    
+    memset(&header, 0, sizeof header);
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof header.magic);
+    for (i = 0; i < SNAPSHOT_REGS; ++i)
+    {
+        if (snapshot_regs[i] == M68K_REG_D0)
+            header.regs[i] = 1; /* Psnapshot returns 1 when resumed */
+        else
+            header.regs[i] = m68k_get_reg(NULL, snapshot_regs[i]);
+    }
+    header.tsize = te->tsize;
+    header.dsize = te->dsize;
+    header.bsize = te->bsize;
+    header.ssize = te->ssize;
+    header.prgflags = te->prgflags;
+    
+    /* Write to a temporary file and rename it into place, so that a restore
+     * never sees a partial snapshot */
+    snprintf(tmp, PATH_MAX, "%s.%d", te->snapshot_path, (int)getpid());
+    f = fopen(tmp, "w");
+    if (!f)
+        return -1;
+    
+    ok = fwrite(&header, sizeof header, 1, f) == 1 &&
+         gemdos_snapshot(f) == 0 &&
+         ftell(f) <= SNAPSHOT_RAM_OFFSET &&
+         fflush(f) == 0;
+    
+    /* Untouched RAM reads as zero pages, skip those to keep the file sparse */
+    fd = fileno(f);
+    for (address = 0; ok && address < USERRAMEND; address += SNAPSHOT_PAGE)
+    {
+        uint8_t *p = (uint8_t*)te->ram + address;
+        
+        if (!is_zero_page(p))
+            ok = pwrite(fd, p, SNAPSHOT_PAGE, SNAPSHOT_RAM_OFFSET + address) == SNAPSHOT_PAGE;
+    }
+    
+    ok = ok && ftruncate(fd, SNAPSHOT_RAM_OFFSET + USERRAMEND) == 0;
+    
+    if (fclose(f) || !ok || rename(tmp, te->snapshot_path))
+    {
+        unlink(tmp);
+        return -1;
+    }
+    
+    return 0;
+}
+
+int restore_snapshot(struct tos_environment *te, const char *path, int argc, char **argv)
+{
+    struct snapshot_header header;
+    FILE *f;
+    int i;
+    
+    f = fopen(path, "r");
+    if (!f)
+    {
+        printf("Error: failed to open snapshot '%s'\n", path);
+        return -1;
+    }
+    
+    if (fread(&header, sizeof header, 1, f) != 1 ||
+        memcmp(header.magic, SNAPSHOT_MAGIC, sizeof header.magic))
+    {
+        printf("Error: '%s' is not a snapshot\n", path);
+        fclose(f);
+        return -1;
+    }
+    
+    te->tsize = header.tsize;
+    te->dsize = header.dsize;
+    te->bsize = header.bsize;
+    te->ssize = header.ssize;
+    te->prgflags = header.prgflags;
+    
+    if (restore_tos_environment(te, fileno(f), SNAPSHOT_RAM_OFFSET, argc, argv) ||
+        gemdos_restore(f))
+    {
+        printf("Error: failed to restore snapshot '%s'\n", path);
+        fclose(f);
+        return -1;
+    }
+    
+    /* The RAM mapping keeps its own reference to the file */
+    fclose(f);
+    
+    /* Continue where the snapshot was taken */
+    for (i = 0; i < SNAPSHOT_REGS; ++i)
+        m68k_set_reg(snapshot_regs[i], header.regs[i]);
+    
+    return 0;
+}
@@ -0,0 +1,49 @@
+/*
+ * TOSEMU - an emulated environment for TOS applications
+ * Copyright (C) 2014 Johan Thelin <e8johan@gmail.com>
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "tossystem.h"
+
+/* Snapshots of a running TOS environment
+ *
+ * A program that spends a long time initializing itself can call the TOSEMU
+ * specific GEMDOS function Psnapshot (0x7E02) once it is ready to do its 
+ * actual work. When tosemu runs with a snapshot file set, the guest RAM, the
+ * CPU registers and the GEMDOS state are saved to it and Psnapshot returns 0.
+ * Restoring the snapshot maps the saved RAM copy-on-write and resumes the 
+ * program with Psnapshot returning 1.
+ */
+
+#define SNAPSHOT_DISABLED (-2)
+
+/* Set the file written by Psnapshot, NULL disables snapshots */
+void snapshot_init(struct tos_environment *te, const char *path);
+
+/* Save a snapshot of the current environment.
+ * Returns 0 on success, SNAPSHOT_DISABLED if no file is set, -1 on failure */
+int save_snapshot();
+
+/* Set up a TOS environment from a snapshot file, with argv replacing the 
+ * command line if non-empty. Returns 0 on success. */
+int restore_snapshot(struct tos_environment *te, const char *path, int argc, char **argv);
+
+#endif /* SNAPSHOT_H */
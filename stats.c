@@ -0,0 +1,111 @@
+/*
+ * TOSEMU - an emulated environment for TOS applications
+ * Copyright (C) 2014 Johan Thelin <e8johan@gmail.com>
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#include "stats.h"
+
+#include <signal.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "tossystem.h"
+#include "gemdos.h"
+#include "bios.h"
+#include "xbios.h"
+
+/* Bumped by SIGUSR1, each environment dumps its counters once it sees a new
+ * value */
+static volatile sig_atomic_t dumps_requested;
+
+int stats_enabled;
+
+static void request_dump(int sig)
+{
+    dumps_requested++;
+}
+
+void stats_init(struct tos_environment *te)
+{
+    memset(&te->stats, 0, sizeof(te->stats));
+    te->stats.dumps_seen = dumps_requested;
+}
+
+void stats_install_signal(void)
+{
+    struct sigaction sa;
+    
+    memset(&sa, 0, sizeof sa);
+    sa.sa_handler = request_dump;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGUSR1, &sa, NULL);
+}
+
+void stats_poll(struct tos_environment *te)
+{
+    unsigned int requested = dumps_requested;
+    
+    if (te->stats.dumps_seen == requested)
+        return;
+    
+    te->stats.dumps_seen = requested;
+    print_tos_stats(te, stderr);
+}
+
+void print_tos_stats(struct tos_environment *te, FILE *f)
+{
+    static const char *dispatchers[STATS_DISPATCHERS] = { "GEMDOS", "BIOS", "XBIOS" };
+    static const char *(*names[STATS_DISPATCHERS])(int) = {
+        gemdos_function_name, bios_function_name, xbios_function_name
+    };
+    struct tos_stats *s = &te->stats;
+    const char *name;
+    int d, i;
+    
+    /* Written as one block, so that dumps of batch jobs do not mix */
+    flockfile(f);
+    
+    fprintf(f, "Statistics of %s after %" PRIu64 " ms\n", te->name ? te->name : "program",
+            tos_elapsed_ms(te));
+    fprintf(f, "  instructions      %" PRIu64 "\n", te->instructions);
+    fprintf(f, "  traps             %" PRIu64 "\n", te->trap_count);
+    fprintf(f, "  Fread bytes       %" PRIu64 "\n", s->bytes_read);
+    fprintf(f, "  Fwrite bytes      %" PRIu64 "\n", s->bytes_written);
+    fprintf(f, "  console in bytes  %" PRIu64 "\n", s->console_in);
+    fprintf(f, "  console out bytes %" PRIu64 "\n", s->console_out);
+    fprintf(f, "  Malloc calls      %" PRIu64 "\n", s->mallocs);
+    fprintf(f, "  Mfree calls       %" PRIu64 "\n", s->mfrees);
+    fprintf(f, "  heap bytes        %" PRIu32 ", peak %" PRIu32 "\n", s->heap, s->heap_peak);
+    if (stats_enabled)
+        fprintf(f, "  area searches     %" PRIu64 ", %" PRIu64 " areas passed\n", 
+                s->area_searches, s->area_search_steps);
+    
+    for (d = 0; d < STATS_DISPATCHERS; d++)
+    {
+        for (i = 0; i < STATS_FUNCTIONS; i++)
+        {
+            if (!s->calls[d][i] || !(name = names[d](i)))
+                continue;
+            fprintf(f, "  %-6s %-10s %" PRIu64 "\n", dispatchers[d], name, s->calls[d][i]);
+        }
+    }
+    
+    fflush(f);
+    funlockfile(f);
+}
@@ -0,0 +1,85 @@
+/*
+ * TOSEMU - an emulated environment for TOS applications
+ * Copyright (C) 2014 Johan Thelin <e8johan@gmail.com>
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* Runtime statistics
+ *
+ * Every TOS environment keeps a set of counters, updated as it runs. They are
+ * printed when the program terminates if tosemu is run with --stats, and 
+ * whenever tosemu receives SIGUSR1.
+ */
+
+/* Trap dispatchers, counting calls by index in their function tables */
+enum {
+    STATS_GEMDOS,
+    STATS_BIOS,
+    STATS_XBIOS,
+    STATS_DISPATCHERS
+};
+
+/* Upper bound of the number of functions of a dispatcher */
+#define STATS_FUNCTIONS (128)
+
+struct tos_stats {
+    uint64_t calls[STATS_DISPATCHERS][STATS_FUNCTIONS];
+    
+    uint64_t bytes_read, bytes_written; /* Through Fread and Fwrite */
+    uint64_t console_in, console_out;   /* Bytes through the console functions */
+    
+    uint64_t mallocs, mfrees;
+    uint32_t heap, heap_peak;           /* Bytes allocated with Malloc */
+    
+    uint64_t area_searches;             /* Memory area searches, with --stats */
+    uint64_t area_search_steps;         /* Areas passed over while searching */
+    
+    unsigned int dumps_seen;            /* See stats_poll */
+};
+
+/* Set by --stats, enables the counters that cost on every memory access */
+extern int stats_enabled;
+
+#define STATS_ENABLED() __builtin_expect(stats_enabled, 0)
+
+struct tos_environment;
+
+/* Counts a call to function index of a dispatcher in the current environment */
+#define STATS_CALL(dispatcher, index) \
+    do { if ((index) < STATS_FUNCTIONS) \
+             tos_current->stats.calls[dispatcher][index]++; } while (0)
+
+/* Clears the counters of te */
+void stats_init(struct tos_environment *te);
+
+/* Writes the counters of te to f */
+void print_tos_stats(struct tos_environment *te, FILE *f);
+
+/* Makes SIGUSR1 request a dump of the counters of all environments */
+void stats_install_signal(void);
+
+/* Prints the counters of te to stderr if a dump was requested since the last
+ * call, called between timeslices */
+void stats_poll(struct tos_environment *te);
+
+#endif /* STATS_H */
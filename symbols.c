@@ -0,0 +1,143 @@
+/*
+ * TOSEMU - an emulated environment for TOS applications
+ * Copyright (C) 2014 Johan Thelin <e8johan@gmail.com>
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#include "symbols.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* DRI symbol types */
+#define SYMBOL_DEFINED  (0x8000)
+#define SYMBOL_EQUATED  (0x4000)
+#define SYMBOL_GLOBAL   (0x2000)
+#define SYMBOL_REGISTER (0x1000)
+#define SYMBOL_EXTERNAL (0x0800)
+#define SYMBOL_DATA     (0x0400)
+#define SYMBOL_TEXT     (0x0200)
+#define SYMBOL_BSS      (0x0100)
+#define SYMBOL_GST_LONG (0x0048) /* The next entry continues the name */
+
+#define SYMBOL_ENTRY_SIZE (14)
+
+static int compare_symbols(const void *a, const void *b)
+{
+    const struct tos_symbol *sa = a, *sb = b;
+    
+    if (sa->address != sb->address)
+        return sa->address < sb->address ? -1 : 1;
+    
+    return strcmp(sa->name, sb->name);
+}
+
+int symbols_load(struct tos_environment *te, const uint8_t *table, uint32_t size,
+                 uint32_t base)
+{
+    struct tos_symbols *symbols;
+    struct tos_symbol *s;
+    uint32_t entries = size / SYMBOL_ENTRY_SIZE;
+    uint32_t end = te->tsize + te->dsize + te->bsize;
+    uint32_t i, value;
+    uint16_t type;
+    
+    te->symbols = 0;
+    if (entries == 0)
+        return 0;
+    
+    symbols = malloc(sizeof(struct tos_symbols) + entries * sizeof(struct tos_symbol));
+    if (!symbols)
+        return -1;
+    
+    symbols->count = 0;
+    symbols->end = base + end;
+    for (i = 0; i < entries; i++) {
+        const uint8_t *entry = table + i * SYMBOL_ENTRY_SIZE;
+        
+        type = (entry[8] << 8) | entry[9];
+        value = ((uint32_t)entry[10] << 24) | (entry[11] << 16) | (entry[12] << 8) | entry[13];
+        
+        s = &symbols->symbol[symbols->count];
+        memcpy(s->name, entry, 8);
+        s->name[8] = 0;
+        if ((type & SYMBOL_GST_LONG) == SYMBOL_GST_LONG && i + 1 < entries) {
+            i++;
+            memcpy(s->name + 8, table + i * SYMBOL_ENTRY_SIZE, 14);
+            s->name[SYMBOL_NAME_MAX] = 0;
+        }
+        
+        /* Only keep labels within the loaded segments */
+        if (!(type & SYMBOL_DEFINED) || (type & (SYMBOL_EQUATED | SYMBOL_REGISTER | SYMBOL_EXTERNAL)) ||
+            !(type & (SYMBOL_TEXT | SYMBOL_DATA | SYMBOL_BSS)) || value >= end || !s->name[0])
+            continue;
+        
+        s->address = base + value;
+        symbols->count++;
+    }
+    
+    qsort(symbols->symbol, symbols->count, sizeof(struct tos_symbol), compare_symbols);
+    te->symbols = symbols;
+    
+    return 0;
+}
+
+void symbols_free(struct tos_environment *te)
+{
+    free(te->symbols);
+    te->symbols = 0;
+}
+
+const struct tos_symbol *symbol_lookup(struct tos_environment *te, uint32_t address,
+                                       uint32_t *offset)
+{
+    struct tos_symbols *symbols = te->symbols;
+    unsigned int low = 0, high, mid;
+    
+    if (!symbols || symbols->count == 0 || address < symbols->symbol[0].address ||
+        address >= symbols->end)
+        return 0;
+    
+    /* Find the last symbol at or below address */
+    high = symbols->count;
+    while (high - low > 1) {
+        mid = (low + high) / 2;
+        if (symbols->symbol[mid].address <= address)
+            low = mid;
+        else
+            high = mid;
+    }
+    
+    *offset = address - symbols->symbol[low].address;
+    return &symbols->symbol[low];
+}
+
+char *format_address(struct tos_environment *te, char *buf, size_t size, uint32_t address)
+{
+    const struct tos_symbol *s;
+    uint32_t offset;
+    
+    if (!(s = symbol_lookup(te, address, &offset)))
+        snprintf(buf, size, "0x%x", address);
+    else if (offset)
+        snprintf(buf, size, "0x%x <%s+0x%x>", address, s->name, offset);
+    else
+        snprintf(buf, size, "0x%x <%s>", address, s->name);
+    
+    return buf;
+}
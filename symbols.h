@@ -0,0 +1,70 @@
+/*
+ * TOSEMU - an emulated environment for TOS applications
+ * Copyright (C) 2014 Johan Thelin <e8johan@gmail.com>
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "tossystem.h"
+
+/* Symbol table of the program
+ *
+ * The symbol table following the segments of the binary is in DRI format,
+ * a sequence of 14 byte entries holding an 8 character name, a type word and
+ * a long value. In the GST extended format, an entry of type 0x48 is followed
+ * by an entry holding 14 more characters of its name. The values of text,
+ * data and bss symbols are offsets from the start of the text segment.
+ *
+ * The symbols of the loaded segments are kept sorted by address, so that
+ * addresses in reports can be printed as symbol+offset.
+ */
+
+/* Longest name of a GST extended symbol */
+#define SYMBOL_NAME_MAX (8 + 14)
+
+struct tos_symbol {
+    uint32_t address;
+    char name[SYMBOL_NAME_MAX + 1];
+};
+
+struct tos_symbols {
+    uint32_t end; /* End of the bss segment */
+    unsigned int count;
+    struct tos_symbol symbol[];
+};
+
+/* Loads the size bytes of symbol table at table for the program of te, 
+ * loaded at base. Returns 0 on success, also for an empty table. */
+int symbols_load(struct tos_environment *te, const uint8_t *table, uint32_t size,
+                 uint32_t base);
+void symbols_free(struct tos_environment *te);
+
+/* Returns the symbol of te at or closest below address within the program,
+ * or NULL. The distance from the symbol is stored in offset. */
+const struct tos_symbol *symbol_lookup(struct tos_environment *te, uint32_t address,
+                                       uint32_t *offset);
+
+/* Formats address as "0x<address>", followed by " <symbol+0x<offset>>" if 
+ * it is within the program of te, into buf of size bytes, returns buf */
+char *format_address(struct tos_environment *te, char *buf, size_t size, uint32_t address);
+
+#endif /* SYMBOLS_H */
@@ -0,0 +1,91 @@
+| TOSEMU - an emulated environment for TOS applications
+| Copyright (C) 2014 Johan Thelin <e8johan@gmail.com>
+| 
+| This program is free software; you can redistribute it and/or
+| modify it under the terms of the GNU General Public License
+| as published by the Free Software Foundation; either version 2
+| of the License, or (at your option) any later version.
+|
+| This program is distributed in the hope that it will be useful,
+| but WITHOUT ANY WARRANTY; without even the implied warranty of
+| MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+| GNU General Public License for more details.
+|
+| You should have received a copy of the GNU General Public License
+| along with this program; if not, write to the Free Software
+| Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+XDEF _start
+
+        .equ bytes,50
+
+.text
+_start:
+        move.w  #0,-(sp)        | read-only
+        pea     fname
+        move.w  #61,-(sp)       | call Fopen
+        trap    #1
+        addq.l  #8,sp
+        
+        tst.w   d0              | check success
+        bmi     fail
+        
+        lea     sqes,a0         | first half of the file
+        move.w  #0,(a0)+        | read
+        move.w  d0,(a0)+        | handle
+        move.l  #buf,(a0)+
+        move.l  #bytes,(a0)+
+        move.l  #0,(a0)+        | offset
+        move.l  #1,(a0)+        | user data
+        
+        move.w  #0,(a0)+        | second half of the file
+        move.w  d0,(a0)+
+        move.l  #buf+bytes,(a0)+
+        move.l  #bytes,(a0)+
+        move.l  #bytes,(a0)+
+        move.l  #2,(a0)+
+        
+        move.l  #2,ring+8       | sq_tail
+        
+        pea     ring
+        move.w  #0x7e00,-(sp)   | call Faiosubmit
+        trap    #1
+        addq.l  #6,sp
+        
+        cmp.l   #2,d0           | check that both were submitted
+        bne     fail
+        
+        move.w  #2,-(sp)        | wait for both
+        pea     ring
+        move.w  #0x7e01,-(sp)   | call Faioreap
+        trap    #1
+        addq.l  #8,sp
+        
+        cmp.l   #2,d0           | check that both completed
+        bne     fail
+        
+        cmpi.l  #bytes,cqes+4   | check results
+        bne     fail
+        cmpi.l  #bytes,cqes+12
+        bne     fail
+        
+        clr.b   buf+2*bytes
+        pea     buf
+        move.w  #9,-(sp)        | call Cconws
+        trap    #1
+        addq.l  #6,sp
+        
+        clr.w   -(sp)           | call Pterm0
+        trap    #1
+        
+fail:   move.w  #1,-(sp)
+        move.w  #0x4c, -(sp)    | call Pterm
+        trap    #1
+
+ring:   dc.w    2,0             | entries
+        dc.l    0,0,0,0         | sq_head, sq_tail, cq_head, cq_tail
+        dc.l    sqes,cqes
+sqes:   ds.b    2*20
+cqes:   ds.b    2*8
+fname:  .ascii  "Makefile\0"
+buf:    ds.b    2*bytes+1
@@ -0,0 +1,33 @@
+| TOSEMU - an emulated environment for TOS applications
+| Copyright (C) 2014 Johan Thelin <e8johan@gmail.com>
+| 
+| This program is free software; you can redistribute it and/or
+| modify it under the terms of the GNU General Public License
+| as published by the Free Software Foundation; either version 2
+| of the License, or (at your option) any later version.
+|
+| This program is distributed in the hope that it will be useful,
+| but WITHOUT ANY WARRANTY; without even the implied warranty of
+| MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+| GNU General Public License for more details.
+|
+| You should have received a copy of the GNU General Public License
+| along with this program; if not, write to the Free Software
+| Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+
+| Reads memory beyond the user RAM from a labelled function, which stops the
+| program with a report naming the function
+
+XDEF _start
+
+.text
+_start:
+        bsr     crash
+
+        clr.w   -(sp)           | call Pterm0, not reached
+        trap    #1
+
+crash:  nop
+        move.l  0xfb0000,d0     | cartridge ROM, not mapped
+        rts
@@ -0,0 +1,44 @@
+| TOSEMU - an emulated environment for TOS applications
+| Copyright (C) 2014 Johan Thelin <e8johan@gmail.com>
+| 
+| This program is free software; you can redistribute it and/or
+| modify it under the terms of the GNU General Public License
+| as published by the Free Software Foundation; either version 2
+| of the License, or (at your option) any later version.
+|
+| This program is distributed in the hope that it will be useful,
+| but WITHOUT ANY WARRANTY; without even the implied warranty of
+| MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+| GNU General Public License for more details.
+|
+| You should have received a copy of the GNU General Public License
+| along with this program; if not, write to the Free Software
+| Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+
+| Spends a few hundred milliseconds in nested functions with A6 frames, for
+| the sampling profiler
+
+XDEF _start
+
+.text
+_start:
+        move.l  #300,d7
+round:  bsr     outer
+        subq.l  #1,d7
+        bne.s   round
+
+        clr.w   -(sp)           | call Pterm0
+        trap    #1
+
+outer:  link    a6,#0
+        bsr     inner
+        unlk    a6
+        rts
+
+inner:  link    a6,#0
+        move.l  #20000,d0
+spin:   subq.l  #1,d0
+        bne.s   spin
+        unlk    a6
+        rts
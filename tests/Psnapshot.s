@@ -0,0 +1,79 @@
+| TOSEMU - an emulated environment for TOS applications
+| Copyright (C) 2014 Johan Thelin <e8johan@gmail.com>
+| 
+| This program is free software; you can redistribute it and/or
+| modify it under the terms of the GNU General Public License
+| as published by the Free Software Foundation; either version 2
+| of the License, or (at your option) any later version.
+|
+| This program is distributed in the hope that it will be useful,
+| but WITHOUT ANY WARRANTY; without even the implied warranty of
+| MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+| GNU General Public License for more details.
+|
+| You should have received a copy of the GNU General Public License
+| along with this program; if not, write to the Free Software
+| Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+XDEF _start
+
+        .equ bytes,10
+
+.text
+_start:
+        move.w  #0,-(sp)        | read-only
+        pea     fname
+        move.w  #61,-(sp)       | call Fopen
+        trap    #1
+        addq.l  #8,sp
+        
+        tst.w   d0              | check success
+        bmi     fail
+        move.w  d0,handle
+        
+        pea     buf             | skip the first bytes before the snapshot
+        move.l  #bytes,-(sp)
+        move.w  handle,-(sp)
+        move.w  #63,-(sp)       | call Fread
+        trap    #1
+        lea     12(sp),sp
+        
+        move.w  #0x7E02,-(sp)   | call Psnapshot
+        trap    #1
+        addq.l  #2,sp
+        
+        tst.l   d0              | 0 when taken, 1 when resumed
+        bmi     fail
+        
+        add.w   #48,d0          | print the result as a digit
+        move.w  d0,-(sp)
+        move.w  #2,-(sp)        | call Cconout
+        trap    #1
+        addq.l  #4,sp
+        
+        pea     buf             | the file position must survive the restore
+        move.l  #bytes,-(sp)
+        move.w  handle,-(sp)
+        move.w  #63,-(sp)       | call Fread
+        trap    #1
+        lea     12(sp),sp
+
+        cmp.l   #bytes,d0       | check success
+        bne     fail
+        
+        clr.b   buf+bytes
+        pea     buf
+        move.w  #9,-(sp)        | call Cconws
+        trap    #1
+        addq.l  #6,sp
+        
+        clr.w   -(sp)           | call Pterm0
+        trap    #1
+        
+fail:   move.w  #1,-(sp)
+        move.w  #0x4c, -(sp)    | call Pterm
+        trap    #1
+
+fname:  .ascii  "Makefile\0"
+handle: dc.w    0
+buf:    ds.b    bytes+1
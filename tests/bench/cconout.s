@@ -0,0 +1,44 @@
+| TOSEMU - an emulated environment for TOS applications
+| Copyright (C) 2014 Johan Thelin <e8johan@gmail.com>
+| 
+| This program is free software; you can redistribute it and/or
+| modify it under the terms of the GNU General Public License
+| as published by the Free Software Foundation; either version 2
+| of the License, or (at your option) any later version.
+|
+| This program is distributed in the hope that it will be useful,
+| but WITHOUT ANY WARRANTY; without even the implied warranty of
+| MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+| GNU General Public License for more details.
+|
+| You should have received a copy of the GNU General Public License
+| along with this program; if not, write to the Free Software
+| Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+| Console output flood: 100000 characters with Cconout, then 10000 lines 
+| with Cconws
+
+XDEF _start
+
+.text
+_start:
+        move.l  #100000,d7
+chars:  move.w  #120,-(sp)      | 'x'
+        move.w  #2,-(sp)        | call Cconout
+        trap    #1
+        addq.l  #4,sp
+        subq.l  #1,d7
+        bne.s   chars
+
+        move.w  #9999,d7
+lines:  pea     line
+        move.w  #9,-(sp)        | call Cconws
+        trap    #1
+        addq.l  #6,sp
+        dbra    d7,lines
+
+        clr.w   -(sp)           | call Pterm0
+        trap    #1
+
+.data
+line:   .ascii  "The quick brown fox jumps over the lazy dog, again and again.\r\n\0"
@@ -0,0 +1,99 @@
+#!/bin/sh
+# TOSEMU - an emulated environment for TOS applications
+# Copyright (C) 2014 Johan Thelin <e8johan@gmail.com>
+# 
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+# Compares benchmark results against a baseline, both written by run.sh
+#
+# Usage: compare.sh <baseline> <results> [<threshold>]
+#
+# Prints a table of the median run time, instructions and traps of every 
+# benchmark in the baseline, and exits with status 1 if any of them is 
+# missing, if a run time has grown by more than threshold percent, 10 by 
+# default, or if a count has changed at all. A run time must in addition grow
+# by more than twice the larger of the two standard deviations, so that noisy
+# benchmarks do not fail at random. The counts are exact, any change of them
+# means the emulator does something different.
+
+if [ $# -lt 2 ]; then
+    echo "Usage: compare.sh <baseline> <results> [<threshold>]" >&2
+    exit 2
+fi
+
+awk -v threshold=${3:-10} '
+    # Returns the number following "key": on the current line
+    function value(key)
+    {
+        if (!match($0, "\"" key "\": [0-9.]+"))
+            return ""
+        return substr($0, RSTART + length(key) + 4, RLENGTH - length(key) - 4) + 0
+    }
+    
+    # A noise of -1 marks an exact count, which must not change at all
+    function compare(name, metric, base, cur, noise)
+    {
+        if (cur == "")
+        {
+            failed++
+            printf "%-10s %-14s %14s %14s %9s  %s\n", name, metric, base, "-", "-", "MISSING"
+            return
+        }
+        change = base > 0 ? (cur - base) * 100 / base : (cur > 0 ? 100 : 0)
+        status = ""
+        if (noise < 0)
+            status = cur != base ? "CHANGED" : ""
+        else if (change > threshold && cur - base > noise)
+            status = "REGRESSION"
+        else if (change < -threshold && base - cur > noise)
+            status = "improved"
+        if (status == "REGRESSION" || status == "CHANGED")
+            failed++
+        printf "%-10s %-14s %14s %14s %+8.1f%%  %s\n", name, metric, base, cur, change, status
+    }
+    
+    FNR == 1 { file++ }
+    !/"name":/ { next }
+    { match($0, /"name": "[^"]*"/); name = substr($0, RSTART + 9, RLENGTH - 10) }
+    
+    file == 1 {
+        names[++count] = name
+        base_us[name] = value("us_median")
+        base_sd[name] = value("us_stddev")
+        base_insns[name] = value("instructions")
+        base_traps[name] = value("traps")
+        next
+    }
+    {
+        cur_us[name] = value("us_median")
+        cur_sd[name] = value("us_stddev")
+        cur_insns[name] = value("instructions")
+        cur_traps[name] = value("traps")
+    }
+    
+    END {
+        printf "%-10s %-14s %14s %14s %9s\n", "benchmark", "metric", "baseline", "current", "change"
+        for (i = 1; i <= count; i++)
+        {
+            n = names[i]
+            sd = base_sd[n] > cur_sd[n] ? base_sd[n] : cur_sd[n]
+            compare(n, "us_median", base_us[n], cur_us[n], 2 * sd)
+            compare(n, "instructions", base_insns[n], cur_insns[n], -1)
+            compare(n, "traps", base_traps[n], cur_traps[n], -1)
+        }
+        if (failed)
+            printf "%d metrics missing, changed or regressed by more than %s%%\n", failed, threshold
+        exit failed ? 1 : 0
+    }' "$1" "$2"
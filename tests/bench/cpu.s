@@ -0,0 +1,61 @@
+| TOSEMU - an emulated environment for TOS applications
+| Copyright (C) 2014 Johan Thelin <e8johan@gmail.com>
+| 
+| This program is free software; you can redistribute it and/or
+| modify it under the terms of the GNU General Public License
+| as published by the Free Software Foundation; either version 2
+| of the License, or (at your option) any later version.
+|
+| This program is distributed in the hope that it will be useful,
+| but WITHOUT ANY WARRANTY; without even the implied warranty of
+| MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+| GNU General Public License for more details.
+|
+| You should have received a copy of the GNU General Public License
+| along with this program; if not, write to the Free Software
+| Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+| CPU-bound loops: block copies, arithmetic and subroutine calls, no traps
+| apart from the final Pterm0
+
+XDEF _start
+
+        .equ rounds,2000
+
+.text
+_start:
+        move.l  #rounds,d7
+
+round:  lea     src,a0          | copy 1 KiB
+        lea     dst,a1
+        move.w  #255,d6
+copy:   move.l  (a0)+,(a1)+
+        dbra    d6,copy
+
+        moveq   #0,d0           | arithmetic on registers
+        moveq   #1,d1
+        move.w  #999,d6
+arith:  add.l   d1,d0
+        and.l   #0x7fffffff,d0
+        or.w    d6,d1
+        cmp.l   d0,d1
+        bne.s   next
+        addq.l  #1,d2
+next:   dbra    d6,arith
+
+        move.w  #99,d6          | subroutine calls
+call:   jsr     leaf
+        dbra    d6,call
+
+        subq.l  #1,d7
+        bne.s   round
+
+        clr.w   -(sp)           | call Pterm0
+        trap    #1
+
+leaf:   addq.l  #1,d3
+        rts
+
+.data
+src:    ds.b    1024
+dst:    ds.b    1024
@@ -0,0 +1,92 @@
+| TOSEMU - an emulated environment for TOS applications
+| Copyright (C) 2014 Johan Thelin <e8johan@gmail.com>
+| 
+| This program is free software; you can redistribute it and/or
+| modify it under the terms of the GNU General Public License
+| as published by the Free Software Foundation; either version 2
+| of the License, or (at your option) any later version.
+|
+| This program is distributed in the hope that it will be useful,
+| but WITHOUT ANY WARRANTY; without even the implied warranty of
+| MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+| GNU General Public License for more details.
+|
+| You should have received a copy of the GNU General Public License
+| along with this program; if not, write to the Free Software
+| Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+| File throughput: writes 8 MiB with Fwrite in 32 KiB blocks, reads it back
+| with Fread and deletes the file
+
+XDEF _start
+
+        .equ block,32768
+        .equ blocks,256
+
+.text
+_start:
+        clr.w   -(sp)
+        pea     fname
+        move.w  #60,-(sp)       | call Fcreate
+        trap    #1
+        addq.l  #8,sp
+        tst.w   d0
+        bmi     fail
+        move.w  d0,d7
+
+        move.w  #blocks-1,d6
+write:  pea     buf
+        move.l  #block,-(sp)
+        move.w  d7,-(sp)
+        move.w  #64,-(sp)       | call Fwrite
+        trap    #1
+        lea     12(sp),sp
+        cmp.l   #block,d0
+        bne     fail
+        dbra    d6,write
+
+        move.w  d7,-(sp)
+        move.w  #62,-(sp)       | call Fclose
+        trap    #1
+        addq.l  #4,sp
+
+        clr.w   -(sp)           | read-only
+        pea     fname
+        move.w  #61,-(sp)       | call Fopen
+        trap    #1
+        addq.l  #8,sp
+        tst.w   d0
+        bmi     fail
+        move.w  d0,d7
+
+read:   pea     buf
+        move.l  #block,-(sp)
+        move.w  d7,-(sp)
+        move.w  #63,-(sp)       | call Fread
+        trap    #1
+        lea     12(sp),sp
+        tst.l   d0
+        bmi     fail
+        bne.s   read
+
+        move.w  d7,-(sp)
+        move.w  #62,-(sp)       | call Fclose
+        trap    #1
+        addq.l  #4,sp
+
+        pea     fname
+        move.w  #65,-(sp)       | call Fdelete
+        trap    #1
+        addq.l  #6,sp
+
+        clr.w   -(sp)           | call Pterm0
+        trap    #1
+
+fail:   move.w  #1,-(sp)
+        move.w  #0x4c,-(sp)     | call Pterm
+        trap    #1
+
+.data
+fname:  .ascii  "BENCH.DAT\0"
+        .even
+buf:    ds.b    block
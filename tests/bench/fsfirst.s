@@ -0,0 +1,61 @@
+| TOSEMU - an emulated environment for TOS applications
+| Copyright (C) 2014 Johan Thelin <e8johan@gmail.com>
+| 
+| This program is free software; you can redistribute it and/or
+| modify it under the terms of the GNU General Public License
+| as published by the Free Software Foundation; either version 2
+| of the License, or (at your option) any later version.
+|
+| This program is distributed in the hope that it will be useful,
+| but WITHOUT ANY WARRANTY; without even the implied warranty of
+| MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+| GNU General Public License for more details.
+|
+| You should have received a copy of the GNU General Public License
+| along with this program; if not, write to the Free Software
+| Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+| Directory traversal: lists the directory BTREE, created by the runner, 50
+| times with Fsfirst and Fsnext
+
+XDEF _start
+
+        .equ rounds,50
+
+.text
+_start:
+        pea     dtabuf
+        move.w  #26,-(sp)       | call Fsetdta
+        trap    #1
+        addq.l  #6,sp
+
+        move.w  #rounds-1,d7
+round:  move.w  #0xff,-(sp)
+        pea     wildcard
+        move.w  #78,-(sp)       | call Fsfirst
+        trap    #1
+        addq.l  #8,sp
+        tst.w   d0
+        bne     fail
+
+next:   addq.l  #1,d5
+        move.w  #79,-(sp)       | call Fsnext
+        trap    #1
+        addq.l  #2,sp
+        tst.w   d0
+        beq.s   next
+
+        dbra    d7,round
+
+        clr.w   -(sp)           | call Pterm0
+        trap    #1
+
+fail:   move.w  #1,-(sp)
+        move.w  #0x4c,-(sp)     | call Pterm
+        trap    #1
+
+.data
+wildcard:
+        .ascii  "BTREE\\*\0"
+        .even
+dtabuf: ds.l    11
@@ -0,0 +1,70 @@
+| TOSEMU - an emulated environment for TOS applications
+| Copyright (C) 2014 Johan Thelin <e8johan@gmail.com>
+| 
+| This program is free software; you can redistribute it and/or
+| modify it under the terms of the GNU General Public License
+| as published by the Free Software Foundation; either version 2
+| of the License, or (at your option) any later version.
+|
+| This program is distributed in the hope that it will be useful,
+| but WITHOUT ANY WARRANTY; without even the implied warranty of
+| MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+| GNU General Public License for more details.
+|
+| You should have received a copy of the GNU General Public License
+| along with this program; if not, write to the Free Software
+| Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+| Memory allocation churn: 20000 rounds of allocating eight blocks with 
+| Malloc and releasing them with Mfree, after shrinking the TPA
+
+XDEF _start
+
+        .equ rounds,20000
+
+.text
+_start:
+        move.l  4(sp),a0        | basepage
+        move.l  #0x10000,-(sp)
+        move.l  a0,-(sp)
+        clr.w   -(sp)
+        move.w  #74,-(sp)       | call Mshrink
+        trap    #1
+        lea     12(sp),sp
+        tst.l   d0
+        bne     fail
+
+        move.l  #rounds,d7
+round:  lea     blocks,a3
+        move.w  #7,d6
+alloc:  move.l  #1024,-(sp)
+        move.w  #72,-(sp)       | call Malloc
+        trap    #1
+        addq.l  #6,sp
+        tst.l   d0
+        beq     fail
+        move.l  d0,(a3)+
+        dbra    d6,alloc
+
+        move.w  #7,d6
+release:
+        move.l  -(a3),-(sp)
+        move.w  #73,-(sp)       | call Mfree
+        trap    #1
+        addq.l  #6,sp
+        tst.l   d0
+        bne     fail
+        dbra    d6,release
+
+        subq.l  #1,d7
+        bne.s   round
+
+        clr.w   -(sp)           | call Pterm0
+        trap    #1
+
+fail:   move.w  #1,-(sp)
+        move.w  #0x4c,-(sp)     | call Pterm
+        trap    #1
+
+.data
+blocks: ds.l    8
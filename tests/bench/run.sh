@@ -0,0 +1,90 @@
+#!/bin/sh
+# TOSEMU - an emulated environment for TOS applications
+# Copyright (C) 2014 Johan Thelin <e8johan@gmail.com>
+# 
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+# Runs the benchmarks and prints the results as JSON
+#
+# Usage: run.sh <tosemu> <name>...
+#
+# Each benchmark bench-<name> is run BENCH_RUNS times, 5 by default, from the
+# current directory with the console discarded. Virtual time makes every run 
+# execute the same instructions. The run time in microseconds of the fastest 
+# run, the median and the standard deviation of the run times are reported 
+# together with the executed instructions and traps, and their rates per 
+# second in the fastest run.
+
+tosemu=$1
+shift
+runs=${BENCH_RUNS:-5}
+
+# Directory listed by the fsfirst benchmark
+mkdir -p BTREE
+i=0
+while [ $i -lt 1000 ]; do
+    : > BTREE/F$i.TXT
+    i=$((i + 1))
+done
+
+echo '{'
+echo "  \"runs\": $runs,"
+echo '  "benchmarks": ['
+sep=''
+for name in "$@"; do
+    : > bench.runs
+    i=0
+    while [ $i -lt $runs ]; do
+        if ! $tosemu --virtual-time --summary=bench.summary bench-$name < /dev/null > /dev/null; then
+            echo "bench-$name failed" >&2
+            rm -rf BTREE bench.summary bench.runs
+            exit 1
+        fi
+        cat bench.summary >> bench.runs
+        i=$((i + 1))
+    done
+    
+    # Summary lines are {"exit": e, "us": t, "instructions": n, "traps": n}
+    awk -v name=$name -v sep="$sep" '
+        { gsub(/[{}":,]/, " "); us[NR] = $4; insns[NR] = $6; traps[NR] = $8 }
+        END {
+            best = 1
+            for (i = 2; i <= NR; i++)
+                if (us[i] < us[best])
+                    best = i
+            for (i = 1; i <= NR; i++)
+                for (j = i + 1; j <= NR; j++)
+                    if (us[j] < us[i]) { t = us[i]; us[i] = us[j]; us[j] = t }
+            mean = 0
+            for (i = 1; i <= NR; i++)
+                mean += us[i] / NR
+            median = (us[int((NR + 1) / 2)] + us[int(NR / 2) + 1]) / 2
+            sd = 0
+            for (i = 1; i <= NR; i++)
+                sd += (us[i] - mean) ^ 2
+            sd = NR > 1 ? sqrt(sd / (NR - 1)) : 0
+            t = insns[best] / (us[1] > 0 ? us[1] : 1) * 1000000
+            printf "%s    {\"name\": \"%s\", \"us\": %d, \"us_median\": %.0f, \"us_stddev\": %.0f, ", sep, name, us[1], median, sd
+            printf "\"instructions\": %d, \"traps\": %d, ", insns[best], traps[best]
+            printf "\"instructions_per_s\": %.0f, ", t
+            printf "\"traps_per_s\": %.0f}", traps[best] / (us[1] > 0 ? us[1] : 1) * 1000000
+        }' bench.runs
+    sep=',\n'
+done
+echo
+echo '  ]'
+echo '}'
+
+rm -rf BTREE bench.summary bench.runs
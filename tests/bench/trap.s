@@ -0,0 +1,45 @@
+| TOSEMU - an emulated environment for TOS applications
+| Copyright (C) 2014 Johan Thelin <e8johan@gmail.com>
+| 
+| This program is free software; you can redistribute it and/or
+| modify it under the terms of the GNU General Public License
+| as published by the Free Software Foundation; either version 2
+| of the License, or (at your option) any later version.
+|
+| This program is distributed in the hope that it will be useful,
+| but WITHOUT ANY WARRANTY; without even the implied warranty of
+| MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+| GNU General Public License for more details.
+|
+| You should have received a copy of the GNU General Public License
+| along with this program; if not, write to the Free Software
+| Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+| Trap dispatch: 200000 calls each of the cheapest GEMDOS, BIOS and XBIOS 
+| functions
+
+XDEF _start
+
+        .equ rounds,200000
+
+.text
+_start:
+        move.l  #rounds,d7
+round:  move.w  #48,-(sp)       | call Sversion
+        trap    #1
+        addq.l  #2,sp
+
+        move.w  #2,-(sp)        | console
+        move.w  #8,-(sp)        | call Bcostat
+        trap    #13
+        addq.l  #4,sp
+
+        move.w  #4,-(sp)        | call Getrez
+        trap    #14
+        addq.l  #2,sp
+
+        subq.l  #1,d7
+        bne.s   round
+
+        clr.w   -(sp)           | call Pterm0
+        trap    #1
@@ -24,12 +24,25 @@
 #include <stddef.h>
 #include <string.h>
 #include <inttypes.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <poll.h>
 
 #include "memory.h"
 #include "utils.h"
+#include "cpu.h"
 #include "gemdos.h"
 #include "xbios.h"
 #include "bios.h"
+#include "trace.h"
+#include "symbols.h"
+#include "profile.h"
+#include "disasm.h"
+#include "verify.h"
 
 #include "m68k.h"
 
@@ -72,52 +85,467 @@ struct exec_header {
 };
 #pragma pack(pop)
 
+/* Program flags of the executable header */
+#define PF_FASTLOAD  (0x01) /* Only clear the BSS, not the entire TPA */
+#define PF_TTRAMLOAD (0x02) /* The program may be loaded into TT-RAM */
+#define PF_TTRAMMEM  (0x04) /* Malloc may return TT-RAM */
+
 #define SUPERMEMSIZE (512)
 
-int keepongoing;
+#define HUGEPAGESIZE (0x200000)
+
+/* Number of instructions to execute per call to m68k_execute, execution is
+ * stopped earlier by halt_execution() */
+#define TIMESLICE (100000)
+
+__thread struct tos_environment *tos_current;
 
-static void copy_cmdlin(char *dest, int argc, char **argv)
+/* The basepage command line holds a length byte followed by the arguments
+ * separated by spaces and NUL-terminated, in at most 128 bytes */
+#define CMDLIN_MAX (124)
+
+void set_tos_cmdline(struct tos_environment *te, int argc, char **argv)
 {
-    char *start = dest;
-    int i, n = 0;
+    char *dest = (char *)te->bp->p_cmdlin;
+    int i, n = 0, len;
 
-    for (i = 0; i < argc; i++)
+    memset(dest, 0, sizeof(te->bp->p_cmdlin));
+    for (i = 0; i < argc && n < CMDLIN_MAX; i++)
     {
         dest[n] = ' ';
         n++;
-        strcpy(dest+n, argv[i]);
-        n += strlen(argv[i]);
+        len = strlen(argv[i]);
+        if (n + len > CMDLIN_MAX)
+            len = CMDLIN_MAX - n;
+        memcpy(dest+n, argv[i], len);
+        n += len;
     }
 
-    *start = n-1;
+    dest[0] = n ? n-1 : 0;
 }
 
-int init_tos_environment(struct tos_environment *te, void *binary, uint64_t size,
-                         int argc, char **argv)
+/* Applies the relocation table following the segments and the symbol table
+ * of the binary to the image in te->appmem. The table is a long offset to the 
+ * first long to relocate, followed by a zero terminated byte stream of 
+ * distances to the next long, where 1 means advance 254 bytes without 
+ * relocating. The table is validated against both the file size and the 
+ * loaded image before any fixup is applied.
+ *
+ * Returns 0 on success, -1 on a malformed table.
+ */
+static int relocate_binary(struct tos_environment *te, uint8_t *binary, uint64_t size)
 {
-    struct exec_header *header;
-    uint8_t *ptr = 0;
-    uint32_t *ptr32 = 0;
-    uint32_t adr = 0;
-    char *path;
+    uint64_t start = sizeof(struct exec_header) + te->tsize + te->dsize + te->ssize;
+    uint64_t image = te->tsize + te->dsize;
+    uint64_t i, end;
+    uint32_t offset, value;
+    uint8_t *ptr;
     
-    /* Ensure that binary is large enough to hold a header */
-    if (size < sizeof(struct exec_header))
+    if (start + 4 > size)
     {
-        printf("Error: Too small binary\n");
+        printf("Error: Missing relocation table\n");
+        return -1;
+    }
+    
+    memcpy(&offset, binary + start, 4);
+    offset = endianize_32(offset);
+    if (offset == 0)
+        return 0; /* Nothing to relocate */
+    
+    /* Validate the table */
+    end = offset;
+    for (i = start + 4; i < size && binary[i]; ++i)
+    {
+        if (binary[i] == 1)
+            end += 254;
+        else if (binary[i] & 1) {
+            printf("Error: Odd relocation distance\n");
+            return -1;
+        } else
+            end += binary[i];
+    }
+    
+    if (i == size)
+    {
+        printf("Error: Unterminated relocation table\n");
+        return -1;
+    }
+    
+    if ((offset & 1) || end + 4 > image)
+    {
+        printf("Error: Relocation outside of the loaded image\n");
+        return -1;
+    }
+    
+    /* Apply the fixups in the host buffer */
+    ptr = (uint8_t*)te->appmem + offset;
+    i = start + 4;
+    for (;;)
+    {
+        memcpy(&value, ptr, 4);
+        value = endianize_32(endianize_32(value) + 0x900);
+        memcpy(ptr, &value, 4);
+        
+        while (binary[i] == 1) {
+            ptr += 254;
+            ++i;
+        }
+        
+        if (binary[i] == 0)
+            break;
+        
+        ptr += binary[i];
+        ++i;
+    }
+    
+    return 0;
+}
+
+/* Maps the guest RAM and places the fixed memory areas within it */
+static int map_guest_ram(struct tos_environment *te)
+{
+    /* Map the guest RAM, committed lazily by the host on first touch */
+    te->ram = mmap(NULL, RAMSIZE, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (te->ram == MAP_FAILED)
+    {
+        te->ram = 0;
+        printf("Error: failed to map guest RAM\n");
         return -1;
     }
     
+    /* Nothing is mapped into the emulated system above the user RAM, guard 
+     * it to catch host side overruns */
+    mprotect((uint8_t*)te->ram + USERRAMEND, RAMSIZE - USERRAMEND, PROT_NONE);
+    
     /* Setup "static" data areas */
-    te->staticmem0 = malloc(0x200);       /* 0x0 - 0x1ff */
-    te->staticmem1 = malloc(0x600-0x380); /* 0x380 - 0x5ff */
+    te->staticmem0 = (uint8_t*)te->ram;         /* 0x0 - 0x1ff */
+    te->staticmem1 = (uint8_t*)te->ram + 0x380; /* 0x380 - 0x5ff */
     
     /* Create supervisor memory for a stack */
-    te->supermem = malloc(SUPERMEMSIZE);
+    te->supermem = (uint8_t*)te->ram + 0x600;
     
     /* Setup a maximum size user RAM */
     te->size = 0xF9FFFF -0x000900;
-    te->appmem = malloc(te->size);
+    te->appmem = (uint8_t*)te->ram + 0x900;
+    
+    /* Place basepage */
+    te->bp = (struct basepage*)((uint8_t*)te->ram + 0x800);
+    
+    return 0;
+}
+
+/* Checks that every RAM memory area maps its guest addresses to the same 
+ * offset in te->ram, which the image cache, snapshots and clear_guest_ram 
+ * write directly */
+static void verify_ram_layout(struct tos_environment *te)
+{
+    static const uint32_t bounds[][2] = {
+        { 0x0, 0x1ff }, { 0x380, 0x600 }, { 0x600, 0x600 + SUPERMEMSIZE }, { 0x800, 0x900 }
+    };
+    uint32_t address, rest;
+    unsigned int i;
+    
+    for (i = 0; i < sizeof(bounds) / sizeof(bounds[0]); ++i)
+        for (address = bounds[i][0]; address < bounds[i][1]; ++address)
+            if (tos_host_mem_extent(address, &rest) != (uint8_t*)te->ram + address)
+                verify_failed("guest RAM at 0x%x is not mapped at its offset", address);
+    
+    /* The user RAM is a single area, its first and last byte settle it */
+    address = 0x900 + te->size - 1;
+    if (tos_host_mem_extent(0x900, &rest) != te->appmem ||
+        tos_host_mem_extent(address, &rest) != (uint8_t*)te->ram + address)
+        verify_failed("user RAM is not mapped at its offset in the guest RAM");
+}
+
+/* Releases the guest RAM, if it was mapped */
+static void unmap_guest_ram(struct tos_environment *te)
+{
+    if (te->ram && te->ram != MAP_FAILED)
+        munmap(te->ram, RAMSIZE);
+    te->ram = 0;
+    te->bp = 0;
+    te->appmem = 0;
+    te->supermem = 0;
+    te->staticmem0 = 0;
+    te->staticmem1 = 0;
+}
+
+void switch_tos_environment(struct tos_environment *te)
+{
+    if (te == tos_current)
+        return;
+    
+    if (tos_current)
+        m68k_get_context(tos_current->cpu);
+    tos_current = te;
+    if (te)
+        m68k_set_context(te->cpu);
+}
+
+/* Makes te current with a reset CPU, registers the memory areas and 
+ * initializes the sub-systems */
+static int setup_system(struct tos_environment *te)
+{
+    char *path;
+    
+    te->cpu = calloc(1, m68k_context_size());
+    if (te->cpu == NULL)
+        return -1;
+    te->snapshot_path = NULL;
+    te->keepongoing = 1;
+    te->exit_code = 0;
+    te->instructions = 0;
+    te->trap_count = 0;
+    stats_init(te);
+    clock_gettime(CLOCK_MONOTONIC, &te->started);
+    te->parkable = 0;
+    te->wait_fd = -1;
+    
+    if (!te->con_in)
+        te->con_in = stdin;
+    if (!te->con_out)
+        te->con_out = stdout;
+    if (!te->con_err)
+        te->con_err = stderr;
+    if (!te->cwd[0] && !getcwd(te->cwd, sizeof(te->cwd)))
+        return -1;
+    
+    switch_tos_environment(te);
+    if (memory_init(te))
+        return -1;
+    
+    add_ptr_memory_area("staticmem0", MEMORY_READWRITE | MEMORY_SUPERWRITE, 0x0, 0x1ff, te->staticmem0);
+    add_fnct_memory_area("magicmem0", MEMORY_SUPERREAD, 0x200, 0x2, 0, magic_xbios_supexec_read, magic_xbios_supexec_write);
+    add_ptr_memory_area("staticmem1", MEMORY_SUPERREAD | MEMORY_SUPERWRITE, 0x380, 0x600-0x380, te->staticmem1); /* TODO this will probably have to be read using a custom function */
+    add_ptr_memory_area("basepage", MEMORY_READWRITE, 0x800, 0x100, te->bp);
+    add_ptr_memory_area("userram", MEMORY_READWRITE, 0x900, te->size, te->appmem);
+    add_ptr_memory_area("superram", MEMORY_SUPERREAD | MEMORY_SUPERWRITE, 0x600, SUPERMEMSIZE, te->supermem);
+    if (VERIFYING())
+        verify_ram_layout(te);
+    
+    path = getenv("TOS_BASE_PATH");
+    if (path == NULL)
+        te->base_path = strdup("");
+    else
+    {
+        int n = strlen(path);
+        te->base_path = malloc(n + 2);
+        if (te->base_path == NULL)
+        {
+            exit(1);
+        }
+        strcpy(te->base_path, path);
+        te->base_path[n] = '/';
+        te->base_path[n+1] = 0;
+    }
+    
+    /* Initialize the CPU, the memory areas must be in place for the reset */
+    m68k_init();
+    m68k_set_cpu_type(M68K_CPU_TYPE_68000);
+    m68k_pulse_reset();
+
+    /* Initialize sub-systems */
+    if (gemdos_init(te) || xbios_init(te))
+        return -1;
+    /* TODO initialization other sub-systems here as well */
+    
+    return 0;
+}
+
+/* Zeroes a range of guest RAM. Whole pages are handed back to the host 
+ * rather than written, so that they are lazily refilled with zeroes on the
+ * next touch instead of being committed by the clearing itself.
+ */
+static void clear_guest_ram(struct tos_environment *te, uint32_t address, uint32_t len)
+{
+    uintptr_t page = sysconf(_SC_PAGESIZE);
+    uint8_t *start = (uint8_t*)te->ram + address;
+    uint8_t *end = start + len;
+    uint8_t *first = (uint8_t*)(((uintptr_t)start + page - 1) & ~(page - 1));
+    uint8_t *last = (uint8_t*)((uintptr_t)end & ~(page - 1));
+    
+    if (first >= last) {
+        memset(start, 0, len);
+        return;
+    }
+    
+    memset(start, 0, first - start);
+    madvise(first, last - first, MADV_DONTNEED);
+    memset(last, 0, end - last);
+    
+    if (VERIFYING()) {
+        uint8_t *p;
+        
+        for (p = start; p < end; ++p)
+            if (*p)
+                verify_failed("cleared guest RAM at 0x%x reads 0x%02x",
+                              (uint32_t)(p - (uint8_t*)te->ram), *p);
+    }
+}
+
+/* Relocated image cache ******************************************************
+ *
+ * When TOS_IMAGE_CACHE names a directory, the relocated text and data of each
+ * binary file is stored there, keyed by the device, inode, size and 
+ * modification time of the file and the load address, which costs nothing 
+ * to compute unlike a hash of the contents. A cache file holds the guest 
+ * memory from address 0 up to the end of the data segment, with everything 
+ * below 0x900 zeroed, so that it can be mapped page aligned and copy-on-write
+ * straight over the guest RAM.
+ */
+
+/* Returns 1 and the cache file name in path if the cache is enabled and the
+ * binary was loaded from the file described by sb */
+static int image_cache_path(char *path, const struct stat *sb)
+{
+    const char *dir = getenv("TOS_IMAGE_CACHE");
+    
+    if (!dir || !sb)
+        return 0;
+    
+    snprintf(path, PATH_MAX, "%s/%" PRIx64 "-%" PRIx64 "-%" PRIx64 "-%" PRIx64 ".%09ld-900.img",
+             dir, (uint64_t)sb->st_dev, (uint64_t)sb->st_ino, (uint64_t)sb->st_size,
+             (uint64_t)sb->st_mtim.tv_sec, (long)sb->st_mtim.tv_nsec);
+    return 1;
+}
+
+/* Maps a cached image over the guest RAM, returns 0 on success */
+static int load_cached_image(struct tos_environment *te, const char *path)
+{
+    struct stat sb;
+    void *res;
+    int fd;
+    
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    
+    if (fstat(fd, &sb) || sb.st_size != 0x900 + te->tsize + te->dsize) {
+        close(fd);
+        return -1;
+    }
+    
+    res = mmap(te->ram, sb.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0);
+    close(fd);
+    
+    return (res == te->ram) ? 0 : -1;
+}
+
+/* Stores the relocated image in te->appmem into the cache */
+static void store_cached_image(struct tos_environment *te, const char *path)
+{
+    char tmp[PATH_MAX];
+    int fd, ok;
+    
+    /* Write to a uniquely named temporary file and rename it into place, so
+     * that concurrent instances and batch jobs never see a partial image */
+    if (snprintf(tmp, PATH_MAX, "%s.XXXXXX", path) >= PATH_MAX)
+        return;
+    fd = mkstemp(tmp);
+    if (fd < 0)
+        return;
+    
+    ok = (fchmod(fd, 0644) == 0) &&
+         (ftruncate(fd, 0x900) == 0) &&
+         (pwrite(fd, te->appmem, te->tsize + te->dsize, 0x900) == te->tsize + te->dsize);
+    close(fd);
+    
+    if (!ok || rename(tmp, path))
+        unlink(tmp);
+}
+
+/* Checks the image loaded from the cache against relocating the binary */
+static void verify_cached_image(struct tos_environment *te, uint8_t *binary, uint64_t size)
+{
+    struct exec_header *header = (struct exec_header*)binary;
+    uint32_t len = te->tsize + te->dsize;
+    uint8_t *cached = malloc(len);
+    uint32_t i;
+    
+    if (!cached)
+        return;
+    
+    memcpy(cached, te->appmem, len);
+    memcpy(te->appmem, binary + sizeof(struct exec_header), len);
+    if (!header->absflag && relocate_binary(te, binary, size))
+        verify_failed("cached image of a binary that does not relocate");
+    
+    for (i = 0; i < len; i++)
+        if (cached[i] != ((uint8_t*)te->appmem)[i])
+            verify_failed("cached image differs at 0x%x, 0x%02x, relocated 0x%02x",
+                          0x900 + i, cached[i], ((uint8_t*)te->appmem)[i]);
+    
+    free(cached);
+}
+
+static int load_binary(struct tos_environment *te, void *binary, uint64_t size,
+                       const struct stat *sb, int argc, char **argv);
+
+int load_tos_binary(struct tos_environment *te, const char *path, int argc, char **argv)
+{
+    void *binary;
+    struct stat sb;
+    int fd, res;
+    
+    /* Open the provided file */
+    fd = open(path, O_RDONLY);
+    if (fd == -1)
+    {
+        printf("Error: failed to open '%s'\n", path);
+        return -1;
+    }
+    
+    /* Mmap the file into memory */
+    if (fstat(fd, &sb) ||
+        (binary = mmap(NULL, sb.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+    {
+        printf("Error: failed to mmap '%s'\n", path);
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    
+    /* Check that the binary starts with the magix 0x601a sequence */
+    if (sb.st_size < 2 || ((char*)binary)[0] != 0x60 || ((char*)binary)[1] != 0x1a)
+    {
+        printf("Error: invalid magic in '%s'\n", path);
+        munmap(binary, sb.st_size);
+        return -1;
+    }
+    
+    res = load_binary(te, binary, sb.st_size, &sb, argc, argv);
+    if (res)
+        printf("Error: failed to initialize TOS environment\n");
+    
+    munmap(binary, sb.st_size);
+    return res;
+}
+
+int init_tos_environment(struct tos_environment *te, void *binary, uint64_t size,
+                         int argc, char **argv)
+{
+    return load_binary(te, binary, size, NULL, argc, argv);
+}
+
+/* Sets up te for a binary, sb describes the file it was loaded from or is 
+ * NULL, in which case the image is not cached */
+static int load_binary(struct tos_environment *te, void *binary, uint64_t size,
+                       const struct stat *sb, int argc, char **argv)
+{
+    struct exec_header *header;
+    char cache_path[PATH_MAX];
+    int cache;
+    
+    /* Ensure that binary is large enough to hold a header */
+    if (size < sizeof(struct exec_header))
+    {
+        printf("Error: Too small binary\n");
+        return -1;
+    }
+    
+    if (map_guest_ram(te))
+        return -1;
     
     /* Copy segment sizes from header */
     header = (struct exec_header*)binary;
@@ -126,11 +554,62 @@ int init_tos_environment(struct tos_environment *te, void *binary, uint64_t size
     te->bsize = endianize_32(header->bsize); 
     te->ssize = endianize_32(header->ssize);
     
-    /* Copy segments into app memory */
-    memcpy(te->appmem, ((uint8_t*)binary) + sizeof(struct exec_header), te->tsize + te->dsize + te->ssize);
+    /* There is only ST-RAM in the emulated system, so the TT-RAM flags are 
+     * satisfied by the normal memory pool */
+    te->prgflags = endianize_32(header->flags);
+    
+    /* Optionally back the program image with huge pages */
+    if (getenv("TOS_HUGEPAGES"))
+    {
+        uint32_t hot = 0x900 + te->tsize + te->dsize + te->bsize;
+        hot = (hot + HUGEPAGESIZE - 1) & ~(HUGEPAGESIZE - 1);
+        if (hot > USERRAMEND)
+            hot = USERRAMEND;
+        madvise(te->ram, hot, MADV_HUGEPAGE);
+    }
+    
+    /* A memory limit shrinks the user RAM, and with it the TPA */
+    if (te->limits.memory && te->limits.memory < te->size)
+        te->size = te->limits.memory & ~3;
+    
+    /* Leave room for the initial stack */
+    if (sizeof(struct exec_header) + te->tsize + te->dsize + te->ssize > size ||
+        (uint64_t)te->tsize + te->dsize + te->bsize + 4 > te->size)
+    {
+        printf("Error: Segments do not fit the binary or the memory\n");
+        goto fail;
+    }
+    
+    /* Load text and data into app memory, either as a cached, already
+     * relocated image, or by copying and relocating the binary */
+    cache = image_cache_path(cache_path, sb);
+    if (!cache || load_cached_image(te, cache_path)) {
+        memcpy(te->appmem, ((uint8_t*)binary) + sizeof(struct exec_header), te->tsize + te->dsize);
         
-    /* Allocate basepage */
-    te->bp = malloc(sizeof(struct basepage));
+        if (!header->absflag) {
+            if (relocate_binary(te, binary, size))
+                goto fail;
+        }
+        
+        if (cache)
+            store_cached_image(te, cache_path);
+    } else if (VERIFYING()) {
+        verify_cached_image(te, binary, size);
+    }
+    
+    /* The image was written behind the back of the memory functions */
+    disasm_free(te);
+    
+    if (symbols_load(te, (uint8_t*)binary + sizeof(struct exec_header) + te->tsize + te->dsize,
+                     te->ssize, 0x900))
+        goto fail;
+    
+    /* Clear the BSS, or the entire TPA above the data segment unless the 
+     * program asked for fast loading */
+    if (te->prgflags & PF_FASTLOAD)
+        clear_guest_ram(te, 0x900 + te->tsize + te->dsize, te->bsize);
+    else
+        clear_guest_ram(te, 0x900 + te->tsize + te->dsize, te->size - te->tsize - te->dsize);
     
     /* Prepare basepage according to memory map from ATARI ST/STE Hårdfakta, page 290
      * 
@@ -172,101 +651,346 @@ int init_tos_environment(struct tos_environment *te, void *binary, uint64_t size
     te->bp->p_parent = 0;
     te->bp->p_env = endianize_32(0x000830); /* TODO, this is cheating, pointing at the undefined, zeroed, memory */
     te->bp->p_dta = 0x800 + offsetof(struct basepage, p_cmdlin);
-    copy_cmdlin((void *)te->bp->p_cmdlin, argc, argv);
+    set_tos_cmdline(te, argc, argv);
         
-    reset_memory();
-    add_ptr_memory_area("staticmem0", MEMORY_READWRITE | MEMORY_SUPERWRITE, 0x0, 0x1ff, te->staticmem0);
-    add_fnct_memory_area("magicmem0", MEMORY_SUPERREAD, 0x200, 0x2, 0, magic_xbios_supexec_read, magic_xbios_supexec_write);
-    add_ptr_memory_area("staticmem1", MEMORY_SUPERREAD | MEMORY_SUPERWRITE, 0x380, 0x600-0x380, te->staticmem1); /* TODO this will probably have to be read using a custom function */
-    add_ptr_memory_area("basepage", MEMORY_READWRITE, 0x800, 0x100, te->bp);
-    add_ptr_memory_area("userram", MEMORY_READWRITE, 0x900, te->size, te->appmem);
-    add_ptr_memory_area("superram", MEMORY_SUPERREAD | MEMORY_SUPERWRITE, 0x600, SUPERMEMSIZE, te->supermem);
+    if (setup_system(te))
+        goto fail;
     
-    /* Relocating the loaded binary, must take place after the "userram" has 
-    * been registered, as it takes place in the memory of the tos machine */
-    if (!header->absflag) {
-        /* Move ptr to the start of the relocation data */
-        ptr = binary;                       /* start of file contents */
-        ptr += sizeof(struct exec_header);  /* skip header */
-        ptr += te->tsize;                   /* skip text segment */
-        ptr += te->dsize;                   /* skip data segment */
-        ptr += te->ssize;                   /* skip symbol table */
-        ptr32 = (uint32_t*)ptr;             /* address of initial offet */
-        ptr += 4;                           /* skip to start of relocation table */
-        /* first relocation address in the tos memory space */
-        adr = 0x900 + endianize_32(*ptr32);
-        
-        if (adr != 0x900) {
-            m68k_write_memory_32(adr, m68k_read_memory_32(adr) + 0x900);
-            while(*ptr)
-            {
-                switch(*ptr)
-                {
-                case 0:
-                    break;
-                case 1:
-                    adr += 0xfe;
-                    ptr ++;
-                    break;
-                default:
-                    adr += *ptr;
-                    ptr ++;
-                    m68k_write_memory_32(adr, m68k_read_memory_32(adr) + 0x900);
-
-                    break;
-                }
-            }
-        }
+    /* TODO is this really correct, or should it be the MSP? If so, why does that not work? */
+    m68k_set_reg(M68K_REG_ISP, 0x600); /* supervisor stack pointer */
+    m68k_set_reg(M68K_REG_USP, te->size-4); /* user stack pointer */
+    m68k_write_memory_32(te->size, 0x800); /* big endian 0x800 */
+    m68k_set_reg(M68K_REG_PC, 0x900); /* Set PC to the binary entry point */
+    disable_supervisor_mode();
+    
+    return 0;
+    
+fail:
+    unmap_guest_ram(te);
+    return -1;
+}
+
+int restore_tos_environment(struct tos_environment *te, int fd, uint64_t offset,
+                            int argc, char **argv)
+{
+    if (map_guest_ram(te))
+        return -1;
+    
+    /* Map the saved guest RAM copy-on-write over the fresh mapping */
+    if (mmap(te->ram, USERRAMEND, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, offset) != te->ram)
+    {
+        printf("Error: failed to map snapshot RAM\n");
+        return -1;
     }
+    disasm_free(te);
+    
+    /* Replace the command line if a new one is given */
+    if (argc > 0)
+        set_tos_cmdline(te, argc, argv);
+    
+    return setup_system(te);
+}
 
-    path = getenv("TOS_BASE_PATH");
-    if (path == NULL)
-        te->base_path = "";
+void free_tos_environment(struct tos_environment *te)
+{
+    if (tos_current == te)
+        switch_tos_environment(NULL);
+    
+    /* Clean up sub-systems */
+    gemdos_free(te);
+    xbios_free(te);
+    /* TODO clean up after other sub-systems here as well */
+    memory_free(te);
+    symbols_free(te);
+    disasm_free(te);
+    
+    free(te->cpu);
+    te->cpu = 0;
+    free(te->base_path);
+    te->base_path = 0;
+
+    /* Jobs that failed to start never mapped their RAM */
+    unmap_guest_ram(te);
+}
+
+/* Runs the current environment for a timeslice, cut short to end at the 
+ * instruction limit */
+static void run_slice(struct tos_environment *te)
+{
+    int slice = PROFILING() ? PROFILE_TIMESLICE : TIMESLICE;
+    int executed;
+    
+    if (te->limits.instructions && te->limits.instructions - te->instructions < slice)
+        slice = te->limits.instructions - te->instructions;
+    
+    /* Added after the slice, a parked trap takes its instruction back */
+    if (TRACING(TRACE_CPU))
+        executed = trace_slice(slice);
     else
+        executed = m68k_execute(slice);
+    te->instructions += executed;
+    check_tos_limits(te);
+    stats_poll(te);
+    if (PROFILING())
+        profile_poll(te);
+}
+
+int run_tos_environment(struct tos_environment *te)
+{
+    switch_tos_environment(te);
+    
+    /* The wall-clock limit counts from here, a server prepares the 
+     * environment long before it is run */
+    clock_gettime(CLOCK_MONOTONIC, &te->started);
+    
+    while (te->keepongoing)
+        run_slice(te);
+    
+    return te->exit_code;
+}
+
+int run_tos_timeslice(struct tos_environment *te)
+{
+    switch_tos_environment(te);
+    if (te->keepongoing)
+        run_slice(te);
+    
+    return te->keepongoing;
+}
+
+static uint64_t elapsed_us(struct tos_environment *te)
+{
+    struct timespec now;
+    
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - te->started.tv_sec) * 1000000 + 
+           (now.tv_nsec - te->started.tv_nsec) / 1000;
+}
+
+uint64_t tos_elapsed_ms(struct tos_environment *te)
+{
+    return elapsed_us(te) / 1000;
+}
+
+/* The run time seen by the limits, which is virtual under virtual time */
+static uint64_t guest_elapsed_ms(struct tos_environment *te)
+{
+    if (virtual_time)
+        return te->instructions / (VIRTUAL_TIME_RATE / 1000);
+    
+    return tos_elapsed_ms(te);
+}
+
+static void stop_at_limit(struct tos_environment *te, const char *limit,
+                          uint64_t instructions)
+{
+    char traps[TRAP_HISTORY * 16] = "";
+    char pc[64];
+    unsigned int n = 0;
+    uint64_t i;
+    uint32_t t;
+    
+    /* Only the first limit hit is reported */
+    if (!te->keepongoing)
+        return;
+    
+    /* List the remembered traps, oldest first */
+    i = te->trap_count > TRAP_HISTORY ? te->trap_count - TRAP_HISTORY : 0;
+    for (; i < te->trap_count; i++)
     {
-        int n = strlen(path);
-        te->base_path = malloc(n + 2);
-        if (te->base_path == NULL)
+        t = te->traps[i % TRAP_HISTORY];
+        switch (t >> 16)
         {
-            exit(1);
+            case 0x21:
+                n += sprintf(traps + n, " GEMDOS 0x%x", t & 0xffff);
+                break;
+            case 0x2d:
+                n += sprintf(traps + n, " BIOS 0x%x", t & 0xffff);
+                break;
+            case 0x2e:
+                n += sprintf(traps + n, " XBIOS 0x%x", t & 0xffff);
+                break;
+            default:
+                n += sprintf(traps + n, " 0x%x", t >> 16);
+                break;
         }
-        strcpy(te->base_path, path);
-        te->base_path[n] = '/';
-        te->base_path[n+1] = 0;
     }
     
-    /* TODO Move into CPU initialization */
-    keepongoing = 1;
+    /* A single call, so that reports from batch workers do not mix */
+    format_address(te, pc, sizeof pc, m68k_get_reg(te == tos_current ? NULL : te->cpu, M68K_REG_PPC));
+    printf("Limit %s exceeded at PC %s after %" PRIu64 " instructions, %" PRIu64 " ms\n"
+           "Last traps:%s\n", limit, pc, instructions, guest_elapsed_ms(te),
+           n ? traps : " none");
+    
+    te->keepongoing = 0;
+    te->exit_code = TOS_LIMIT_EXIT;
+    if (te == tos_current)
+        m68k_end_timeslice();
+}
 
-    /* Initialize sub-systems */
-    gemdos_init(te);
-    /* TODO initialization other sub-systems here as well */
+void tos_limit_exceeded(struct tos_environment *te, const char *limit)
+{
+    /* The current timeslice is not counted until m68k_execute returns */
+    stop_at_limit(te, limit, te->instructions + m68k_cycles_run());
+}
+
+int check_tos_limits(struct tos_environment *te)
+{
+    if (!te->keepongoing)
+        return 0;
+    
+    if (te->limits.instructions && te->instructions >= te->limits.instructions)
+        stop_at_limit(te, "max-instructions", te->instructions);
+    else if (te->limits.ms && guest_elapsed_ms(te) >= te->limits.ms)
+        stop_at_limit(te, "max-time", te->instructions);
+    else
+        return 0;
+    
+    return 1;
+}
+
+int write_tos_summary(struct tos_environment *te, const char *path)
+{
+    FILE *f;
+    int r;
+    
+    f = fopen(path, "w");
+    if (!f)
+        return -1;
+    
+    fprintf(f, "{\"exit\": %d, \"us\": %" PRIu64 ", \"instructions\": %" PRIu64 
+            ", \"traps\": %" PRIu64 "}\n", te->exit_code, elapsed_us(te), 
+            te->instructions, te->trap_count);
+    r = ferror(f);
+    
+    return (fclose(f) || r) ? -1 : 0;
+}
+
+int parse_tos_limit(struct tos_limits *limits, const char *opt)
+{
+    unsigned long long n, unit = 1000;
+    uint64_t memory, *field = &memory;
+    const char *value;
+    char *end;
+    
+    if (strncmp("max-instructions=", opt, 17) == 0)
+    {
+        value = opt + 17;
+        field = &limits->instructions;
+    }
+    else if (strncmp("max-time=", opt, 9) == 0)
+    {
+        value = opt + 9;
+        field = &limits->ms;
+    }
+    else if (strncmp("max-memory=", opt, 11) == 0)
+    {
+        value = opt + 11;
+        unit = 1024;
+    }
+    else
+        return 1;
+    
+    errno = 0;
+    n = strtoull(value, &end, 10);
+    if (errno || end == value || value[0] == '-')
+        return -1;
+    
+    switch (*end)
+    {
+        case 'G':
+            n *= unit;
+            /* Fall through */
+        case 'M':
+            n *= unit;
+            /* Fall through */
+        case 'k':
+            n *= unit;
+            end++;
+            break;
+    }
+    if (*end)
+        return -1;
+    
+    *field = n;
+    if (field == &memory)
+        limits->memory = n > UINT32_MAX ? UINT32_MAX : n;
     
     return 0;
 }
 
-void free_tos_environment(struct tos_environment *te)
+int park_on_fd(int fd)
 {
-    /* Clean up sub-systems */
-    gemdos_free();
-    /* TODO clean up after other sub-systems here as well */
+    struct tos_environment *te = tos_current;
+    
+    /* Under virtual time, parking would end timeslices at points that 
+     * depend on the host */
+    if (!te->parkable || virtual_time)
+        return 0;
+    
+    /* The traps are handled without an exception frame, so the PC is just 
+     * past the trap instruction. The trap instruction and its history entry
+     * are taken back, the retry counts them. */
+    te->wait_fd = fd;
+    m68k_set_reg(M68K_REG_PC, m68k_get_reg(NULL, M68K_REG_PC) - 2);
+    m68k_end_timeslice();
+    te->instructions--;
+    te->trap_count--;
+    
+    return 1;
+}
 
-    free(te->bp);
-    te->bp = 0;
+/* Returns non-zero unless a read from f would block. Readable, end of file
+ * and errors all let the read go ahead. */
+static int input_ready(FILE *f)
+{
+    struct pollfd p;
+    int flags, c;
     
-    free(te->appmem);
-    te->appmem = 0;
+    p.fd = fileno(f);
+    p.events = POLLIN;
+    if (poll(&p, 1, 0) != 0)
+        return 1;
     
-    free(te->supermem);
-    te->supermem = 0;
+    /* Input already buffered in the stream is not seen by poll, peek at it
+     * without letting the stream block on the fd */
+    flags = fcntl(p.fd, F_GETFL);
+    if (flags < 0 || fcntl(p.fd, F_SETFL, flags | O_NONBLOCK) < 0)
+        return 1;
+    errno = 0;
+    c = getc(f);
+    fcntl(p.fd, F_SETFL, flags);
     
-    reset_memory();
+    if (c != EOF) {
+        ungetc(c, f);
+        return 1;
+    }
+    if (ferror(f) && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        clearerr(f);
+        return 0;
+    }
+    
+    return 1;
+}
+
+int park_on_input(FILE *f)
+{
+    struct tos_environment *te = tos_current;
+    
+    if (!te->parkable || virtual_time || input_ready(f))
+        return 0;
+    
+    return park_on_fd(fileno(f));
 }
 
 /* Invoked upon trap instructions */
 
 void m68k_trap(unsigned int vector)
 {
+    struct tos_environment *te = tos_current;
+    
+    te->traps[te->trap_count++ % TRAP_HISTORY] = vector << 16 | peek_u16(0);
+    
     switch(vector)
     {
         case 0x21: /* trap #$1, GEMDOS */
@@ -291,5 +1015,8 @@ void m68k_trap(unsigned int vector)
 
 void halt_execution()
 {
-    keepongoing = 0;
+    tos_current->keepongoing = 0;
+    
+    /* Stop the CPU after the current instruction */
+    m68k_end_timeslice();
 }
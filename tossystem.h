@@ -22,10 +22,47 @@
 #define TOSSYSTEM_H
 
 #include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <linux/limits.h>
+
+#include "stats.h"
 
 struct basepage;
 
+/* Sub-system state, each private to its sub-system */
+struct memory_state;
+struct gemdos_mem_state;
+struct gemdos_file_state;
+struct gemdos_aio_state;
+struct xbios_state;
+struct tos_symbols; /* See symbols.h */
+struct disasm_cache; /* See disasm.h */
+
+/* The entire 24-bit address space is backed by a single host mapping. Host
+ * pages are only committed when first touched, so the unused parts of the
+ * user RAM cost nothing. */
+#define RAMSIZE (0x1000000)
+#define USERRAMEND (0xFA0000)
+
+/* The text segment of the program is loaded at the start of the user RAM */
+#define USERRAMSTART (0x900)
+
+/* Resource limits of an environment, zero means unlimited. A program hitting
+ * a limit is stopped with the exit code TOS_LIMIT_EXIT. */
+struct tos_limits {
+    uint64_t instructions; /* Executed instructions */
+    uint64_t ms;           /* Wall-clock run time in milliseconds */
+    uint32_t memory;       /* User RAM in bytes, not applied to snapshots */
+};
+#define TOS_LIMIT_EXIT (125)
+
+/* Number of traps remembered for the report of a hit limit */
+#define TRAP_HISTORY (8)
+
 struct tos_environment {
+    void *ram; /* Host mapping of the entire emulated address space */
+    
     uint64_t size;
     void *appmem;
     void *supermem;
@@ -36,16 +73,115 @@ struct tos_environment {
              dsize, 
              bsize, 
              ssize;
+    uint32_t prgflags;
 
     struct basepage *bp;
 
     char *base_path;
+    const char *name; /* Program name for reports, set by the caller or NULL */
+    const char *snapshot_path; /* See snapshot_init */
+    
+    /* Set before the environment is set up to redirect the console, handles
+     * 0-2, and the working directory. Default to the host's own. */
+    FILE *con_in, *con_out, *con_err;
+    char cwd[PATH_MAX];
+    
+    int keepongoing; /* Cleared by halt_execution() */
+    int exit_code;   /* Set when the program terminates */
+    
+    struct tos_limits limits; /* Set before the environment is set up */
+    uint64_t instructions;    /* Executed so far */
+    struct timespec started;  /* Start of the run, CLOCK_MONOTONIC */
+    uint32_t traps[TRAP_HISTORY]; /* Ring of vector << 16 | function */
+    uint64_t trap_count;
+    struct tos_stats stats;
+    int profile_ticks_seen; /* See profile_poll */
+    
+    int parkable; /* Set to let park_on_input() suspend the program */
+    int wait_fd;  /* Host fd the parked program waits for, -1 if runnable */
+    
+    void *cpu; /* Musashi context, holds the CPU while not current */
+    
+    struct memory_state *memory;
+    struct gemdos_mem_state *gemdos_mem;
+    struct gemdos_file_state *gemdos_file;
+    struct gemdos_aio_state *gemdos_aio;
+    struct xbios_state *xbios;
+    struct tos_symbols *symbols;
+    struct disasm_cache *disasm;
 };
 
+/* A single host process can hold any number of TOS environments, but the CPU
+ * core and the sub-systems only operate on the current one of each thread. 
+ * Setting up an environment makes it current. */
+extern __thread struct tos_environment *tos_current;
+
+/* Makes te the current environment. The CPU state of the previously current
+ * environment is saved in its context. Must not be called from inside 
+ * m68k_execute. */
+void switch_tos_environment(struct tos_environment *te);
+
+/* Sets up a TOS environment with the CPU ready to start the binary, loaded 
+ * from the file at path or given in memory. Return 0 on success. Only the 
+ * images of files are kept in TOS_IMAGE_CACHE. */
+int load_tos_binary(struct tos_environment *te, const char *path, int argc, char **argv);
 int init_tos_environment(struct tos_environment *te, void *binary,
                          uint64_t binary_size, int argc, char **argv);
+
+/* Sets up a TOS environment around guest RAM saved at offset in the snapshot
+ * file fd, see snapshot.h. A non-empty argv replaces the saved command line. */
+int restore_tos_environment(struct tos_environment *te, int fd, uint64_t offset,
+                            int argc, char **argv);
 void free_tos_environment(struct tos_environment *te);
 
+/* Makes te current and runs it until the program terminates, returns the 
+ * exit code of the program */
+int run_tos_environment(struct tos_environment *te);
+
+/* Makes te current and runs a single timeslice, returns non-zero while the 
+ * program is still running */
+int run_tos_timeslice(struct tos_environment *te);
+
+/* Returns the milliseconds since te started running */
+uint64_t tos_elapsed_ms(struct tos_environment *te);
+
+/* Stops the program of te if one of its limits is exceeded, returns non-zero
+ * if it was stopped. May be called from any thread. */
+int check_tos_limits(struct tos_environment *te);
+
+/* Stops the program of te with a report of the hit limit, called while te is
+ * executing */
+void tos_limit_exceeded(struct tos_environment *te, const char *limit);
+
+/* Writes the exit code, run time in microseconds and number of executed 
+ * instructions and traps of te as a JSON object to the file at path, returns
+ * 0 on success */
+int write_tos_summary(struct tos_environment *te, const char *path);
+
+/* Parses a limit option, without the leading dashes, on the form 
+ * max-instructions=<n>, max-time=<ms> or max-memory=<bytes>, where the 
+ * numbers take an optional k, M or G suffix. Returns 0 on success, 1 if opt
+ * is not a limit and -1 if its value is invalid. */
+int parse_tos_limit(struct tos_limits *limits, const char *opt);
+
+/* Called by trap handlers before reading from a host stream that may block.
+ * If the current environment is parkable and no input is available, the 
+ * trap is rewound to be retried, the timeslice ended and 1 returned, the 
+ * handler must then return without reading. Otherwise returns 0. */
+int park_on_input(FILE *f);
+
+/* Suspends the current trap like park_on_input until fd becomes readable, 
+ * for handlers that wait for something else than a stream. Returns 0 if the
+ * environment cannot be parked, the handler must then wait itself. */
+int park_on_fd(int fd);
+
+/* Non-zero when the current trap was parked, it is retried and is not 
+ * counted or traced until then */
+#define TRAP_PARKED() (tos_current->wait_fd >= 0)
+
+/* Replaces the command line in the basepage, truncated to what fits */
+void set_tos_cmdline(struct tos_environment *te, int argc, char **argv);
+
 void halt_execution();
 
 #endif /* TOSSYSTEM_H */
@@ -0,0 +1,232 @@
+/*
+ * TOSEMU - an emulated environment for TOS applications
+ * Copyright (C) 2014 Johan Thelin <e8johan@gmail.com>
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "m68k.h"
+#include "cpu.h"
+#include "tossystem.h"
+
+/* Upper bound of the length of a trace line, longer arguments are cut */
+#define TRACE_LINE_MAX (256)
+
+/* Size of the buffer of the trace file */
+#define TRACE_BUFFER_SIZE (1 << 20)
+
+unsigned int trace_mask;
+
+static FILE *trace_file;
+static enum trace_format trace_format;
+static struct timespec trace_started; /* Time zero of the chrome events */
+
+static const char *dispatchers[STATS_DISPATCHERS + 1] = { "GEMDOS", "BIOS", "XBIOS", "CPU" };
+
+int parse_trace_mask(const char *list)
+{
+    unsigned int mask = 0;
+    size_t len;
+    int d;
+    
+    while (*list) {
+        len = strcspn(list, ",");
+        for (d=0; d<=TRACE_CPU; ++d)
+            if (len == strlen(dispatchers[d]) && strncasecmp(list, dispatchers[d], len) == 0)
+                break;
+        if (d > TRACE_CPU)
+            return -1;
+        
+        mask |= 1 << d;
+        list += len;
+        if (*list == ',')
+            list++;
+    }
+    
+    return mask;
+}
+
+int parse_trace_format(const char *name)
+{
+    if (strcmp(name, "text") == 0)
+        return TRACE_TEXT;
+    if (strcmp(name, "chrome") == 0)
+        return TRACE_CHROME;
+    
+    return -1;
+}
+
+static void trace_close(void)
+{
+    trace_mask = 0;
+    
+    /* Ends the array with the name of the process, as it has no trailing
+     * comma */
+    if (trace_format == TRACE_CHROME)
+        fprintf(trace_file, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %d, "
+                "\"args\": {\"name\": \"tosemu\"}}\n]\n", (int)getpid());
+    
+    fclose(trace_file);
+}
+
+int trace_open(const char *path, unsigned int mask, enum trace_format format, int job)
+{
+    char job_path[PATH_MAX];
+    
+    /* Server jobs are forked processes sharing the option, each writes a 
+     * file of its own rather than mixing its buffer into a shared one */
+    if (job) {
+        if (snprintf(job_path, sizeof job_path, "%s.%d", path, (int)getpid()) >= (int)sizeof job_path)
+            return -1;
+        path = job_path;
+    }
+    
+    trace_file = fopen(path, "w");
+    if (!trace_file)
+        return -1;
+    
+    setvbuf(trace_file, NULL, _IOFBF, TRACE_BUFFER_SIZE);
+    if (format == TRACE_CHROME)
+        fprintf(trace_file, "[\n");
+    
+    clock_gettime(CLOCK_MONOTONIC, &trace_started);
+    atexit(trace_close);
+    trace_format = format;
+    trace_mask = mask;
+    
+    return 0;
+}
+
+static uint64_t elapsed_ns(const struct timespec *start, const struct timespec *end)
+{
+    return (uint64_t)(end->tv_sec - start->tv_sec) * 1000000000 + end->tv_nsec - start->tv_nsec;
+}
+
+/* Copies s into buf as the contents of a JSON string, cut at size */
+static void json_escape(char *buf, size_t size, const char *s)
+{
+    size_t len = 0;
+    
+    for (; *s && len + 7 < size; ++s) {
+        if (*s == '"' || *s == '\\') {
+            buf[len++] = '\\';
+            buf[len++] = *s;
+        } else if ((unsigned char)*s < 0x20) {
+            len += sprintf(buf + len, "\\u%04x", (unsigned char)*s);
+        } else {
+            buf[len++] = *s;
+        }
+    }
+    buf[len] = 0;
+}
+
+/* Writes a chrome complete event, args is the contents of its args object */
+static void write_event(const char *name, const char *category, const struct timespec *start,
+                        const struct timespec *end, const char *args)
+{
+    char program[TRACE_LINE_MAX];
+    
+    json_escape(program, sizeof program, tos_current->name ? tos_current->name : "-");
+    
+    /* One write per event, so that the events of batch jobs do not mix */
+    fprintf(trace_file, "{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", "
+            "\"ts\": %.3f, \"dur\": %.3f, \"pid\": %d, \"tid\": %ld, "
+            "\"args\": {\"program\": \"%s\", %s}},\n",
+            name, category, elapsed_ns(&trace_started, start) / 1000.0,
+            elapsed_ns(start, end) / 1000.0, (int)getpid(), (long)syscall(SYS_gettid),
+            program, args);
+}
+
+/* Bytes moved through files and the console by the current environment */
+static uint64_t bytes_transferred(void)
+{
+    struct tos_stats *s = &tos_current->stats;
+    
+    return s->bytes_read + s->bytes_written + s->console_in + s->console_out;
+}
+
+uint32_t trace_call(int dispatcher, const char *name, const char *signature,
+                    uint32_t (*fnct)(const uint32_t *), const uint32_t *args)
+{
+    struct tos_environment *te = tos_current;
+    char call[TRACE_LINE_MAX], escaped[TRACE_LINE_MAX], event[2 * TRACE_LINE_MAX];
+    uint64_t instructions = te->instructions + m68k_cycles_run();
+    uint64_t bytes = bytes_transferred();
+    struct timespec start, end;
+    uint32_t r;
+    
+    /* The arguments are formatted before the call, which may overwrite what
+     * they point to */
+    format_trap_args(call, sizeof call, name, signature, args);
+    
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    r = fnct(args);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    
+    /* A parked call is logged once it is retried and completes */
+    if (TRAP_PARKED())
+        return r;
+    
+    if (trace_format == TRACE_CHROME) {
+        json_escape(escaped, sizeof escaped, call);
+        snprintf(event, sizeof event, "\"call\": \"%s\", \"result\": %d, \"bytes\": %" PRIu64
+                 ", \"instructions\": %" PRIu64, escaped, (int32_t)r,
+                 bytes_transferred() - bytes, instructions);
+        write_event(name, dispatchers[dispatcher], &start, &end, event);
+    } else {
+        /* One write per line, so that the calls of batch jobs do not mix */
+        fprintf(trace_file, "%s\t%" PRIu64 "\t%s\t%s\t%d\t%" PRIu64 "\n",
+                te->name ? te->name : "-", instructions, dispatchers[dispatcher],
+                call, (int32_t)r, elapsed_ns(&start, &end));
+    }
+    
+    return r;
+}
+
+int trace_slice(int slice)
+{
+    struct tos_environment *te = tos_current;
+    struct timespec start, end;
+    char event[TRACE_LINE_MAX];
+    int n;
+    
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    n = m68k_execute(slice);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    
+    if (trace_format == TRACE_CHROME) {
+        snprintf(event, sizeof event, "\"instructions\": %d", n);
+        write_event("m68k", dispatchers[TRACE_CPU], &start, &end, event);
+    } else {
+        fprintf(trace_file, "%s\t%" PRIu64 "\t%s\tm68k(%d)\t%d\t%" PRIu64 "\n",
+                te->name ? te->name : "-", te->instructions, dispatchers[TRACE_CPU],
+                slice, n, elapsed_ns(&start, &end));
+    }
+    
+    return n;
+}
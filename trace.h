@@ -0,0 +1,91 @@
+/*
+ * TOSEMU - an emulated environment for TOS applications
+ * Copyright (C) 2014 Johan Thelin <e8johan@gmail.com>
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+#include "stats.h"
+
+/* Syscall tracing
+ *
+ * With --trace=gemdos,bios,xbios every call through the selected dispatchers
+ * is logged to a separate trace file, one line per call with tab separated
+ * fields:
+ *
+ *   <program> <instructions> <dispatcher> <name>(<args>) <result> <ns>
+ *
+ * where instructions is the instruction count at the time of the call and ns
+ * the host time spent in the call. The dispatchers are numbered as in
+ * stats.h, and the pseudo dispatcher cpu logs each timeslice of the CPU as
+ * a call m68k(<instructions>).
+ *
+ * With --trace-format=chrome the file is instead a JSON array of Chrome
+ * trace events, for chrome://tracing or Perfetto. Each call and timeslice is
+ * a complete event on the row of the host thread running it, so the calls
+ * show up nested within the timeslices. Calls carry their arguments, result
+ * and the bytes they moved through files and the console.
+ *
+ * The trace file is fully buffered and written when it is closed, so that
+ * tracing changes the timing of the traced program as little as possible.
+ */
+
+/* Trace file used if none is given */
+#define TRACE_FILE "tosemu.trace"
+
+/* Pseudo dispatcher of the timeslices of the CPU */
+#define TRACE_CPU STATS_DISPATCHERS
+
+enum trace_format {
+    TRACE_TEXT,
+    TRACE_CHROME
+};
+
+/* Bit 1 << dispatcher is set for each traced dispatcher, zero if tracing is
+ * off */
+extern unsigned int trace_mask;
+
+/* True if calls through dispatcher are traced, a single branch predicted not
+ * taken when tracing is off */
+#define TRACING(dispatcher) __builtin_expect((trace_mask >> (dispatcher)) & 1, 0)
+
+/* Parses a comma separated list of dispatcher names, such as "gemdos,cpu",
+ * returns the mask or -1 for an unknown name */
+int parse_trace_mask(const char *list);
+
+/* Parses "text" or "chrome", returns the format or -1 */
+int parse_trace_format(const char *name);
+
+/* Starts tracing the dispatchers of mask to the file at path, returns 0 on
+ * success. The file is closed at exit. A server opens the trace in each job,
+ * with job set so that it is written to <path>.<pid> instead. */
+int trace_open(const char *path, unsigned int mask, enum trace_format format, int job);
+
+/* Calls fnct with the decoded args of a trap and logs the call, returns the
+ * result of fnct */
+uint32_t trace_call(int dispatcher, const char *name, const char *signature,
+                    uint32_t (*fnct)(const uint32_t *), const uint32_t *args);
+
+/* Executes a timeslice of at most slice instructions in the current
+ * environment and logs it, returns the number of executed instructions */
+int trace_slice(int slice);
+
+#endif /* TRACE_H */
@@ -23,35 +23,36 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <errno.h>
 
-uint16_t endianize_16(uint16_t in)
+#include "tossystem.h"
+#include "m68k.h"
+
+int virtual_time;
+time_t virtual_epoch = VIRTUAL_TIME_EPOCH;
+
+int parse_virtual_epoch(const char *value)
 {
-    uint16_t out;
-    int i;
+    long long epoch;
+    char *end;
     
-    for(i=0; i<2; ++i)
-    {
-        out = out << 8;
-        out = out | (0xff&in);
-        in = in >> 8;
-    }
+    errno = 0;
+    epoch = strtoll(value, &end, 0);
+    if (errno || end == value || *end || (time_t)epoch != epoch)
+        return -1;
     
-    return out;
+    virtual_epoch = epoch;
+    return 0;
+}
+
+uint16_t endianize_16(uint16_t in)
+{
+    return __builtin_bswap16(in);
 }
 
 uint32_t endianize_32(uint32_t in)
 {
-    uint32_t out;
-    int i;
-    
-    for(i=0; i<4; ++i)
-    {
-        out = out << 8;
-        out = out | (0xff&in);
-        in = in >> 8;
-    }
-    
-    return out;
+    return __builtin_bswap32(in);
 }
 
 /* Checks if the console has available input
@@ -61,14 +62,38 @@ int console_input_available()
 {
     struct timeval tv;
     fd_set fds;
+    int fd = fileno(tos_current->con_in);
+    int c;
+    
+    /* A script has input until its end, however fast it is produced */
+    if (virtual_time) {
+        if ((c = getc(tos_current->con_in)) == EOF)
+            return 0;
+        ungetc(c, tos_current->con_in);
+        return 1;
+    }
 
     tv.tv_sec = 0;
     tv.tv_usec = 0;
 
     FD_ZERO(&fds);
-    FD_SET(STDIN_FILENO, &fds);
+    FD_SET(fd, &fds);
 
-    select(STDIN_FILENO+1, &fds, NULL, NULL, &tv);
+    select(fd+1, &fds, NULL, NULL, &tv);
+
+    return (FD_ISSET(fd, &fds));
+}
 
-    return (FD_ISSET(0, &fds));
+struct tm *guest_time(struct tm *tm)
+{
+    time_t t;
+    
+    if (virtual_time) {
+        /* Called from traps, while the CPU runs */
+        t = virtual_epoch + (tos_current->instructions + m68k_cycles_run()) / VIRTUAL_TIME_RATE;
+        return gmtime_r(&t, tm);
+    }
+    
+    t = time(NULL);
+    return localtime_r(&t, tm);
 }
@@ -22,6 +22,7 @@
 #define UTILS_H
 
 #include <stdint.h>
+#include <time.h>
 
 /* Changes endianess of a 16-bits word */
 uint16_t endianize_16(uint16_t in);
@@ -32,4 +33,23 @@ uint32_t endianize_32(uint32_t in);
 /* Checks if the console has available input */
 int console_input_available();
 
+/* Guest instructions per second of virtual time, about a 68000 at 8 MHz */
+#define VIRTUAL_TIME_RATE (2000000)
+
+/* Start of virtual time, 2000-01-01 00:00:00 UTC */
+#define VIRTUAL_TIME_EPOCH (946684800)
+
+/* When set, all time seen by the guest derives from the instructions it has 
+ * executed, counted from virtual_epoch, and the console input is read as a 
+ * script, so that runs with the same input execute the same instructions */
+extern int virtual_time;
+extern time_t virtual_epoch;
+
+/* Parses the start of virtual time in seconds since 1970, returns 0 and sets
+ * virtual_epoch, or -1 for a malformed value */
+int parse_virtual_epoch(const char *value);
+
+/* Fills in the guest's local time, returns tm */
+struct tm *guest_time(struct tm *tm);
+
 #endif /* UTILS_H */
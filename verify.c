@@ -18,25 +18,32 @@
  *
  */
 
+#include "verify.h"
+
 #include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
 
-/* Enable and disable detailed tracing for the various sub-systems of tosemu */
-/* #define ENABLE_GEMDOS_TRACE */
-/* #define ENABLE_BIOS_TRACE */
-/* #define ENABLE_XBIOS_TRACE */
-/* #define ENABLE_AES_TRACE */
-/* #define ENABLE_VDI_TRACE */
+#include "tossystem.h"
+#include "m68k.h"
 
-/* Tracing functions */
+int verify_enabled;
 
-#if (defined(ENABLE_GEMDOS_TRACE) && defined(GEMDOS_TRACE_CONTEXT)) || \
-    (defined(ENABLE_BIOS_TRACE) && defined(BIOS_TRACE_CONTEXT)) || \
-    (defined(ENABLE_XBIOS_TRACE) && defined(XBIOS_TRACE_CONTEXT)) || \
-    (defined(ENABLE_AES_TRACE) && defined(AES_TRACE_CONTEXT)) || \
-    (defined(ENABLE_VDI_TRACE) && defined(VDI_TRACE_CONTEXT))
-#define     FUNC_TRACE_ENTER      printf("Enter %s\n", __func__);
-#define     FUNC_TRACE_ENTER_ARGS printf("Enter %s\n", __func__); if(1)
-#else
-#define     FUNC_TRACE_ENTER
-#define     FUNC_TRACE_ENTER_ARGS if(0)
-#endif
+void verify_failed(const char *format, ...)
+{
+    struct tos_environment *te = tos_current;
+    va_list ap;
+    
+    fflush(stdout);
+    if (te && te->name)
+        fprintf(stderr, "Verification failed in %s at PC 0x%x: ",
+                te->name, m68k_get_reg(NULL, M68K_REG_PPC));
+    else
+        fprintf(stderr, "Verification failed: ");
+    va_start(ap, format);
+    vfprintf(stderr, format, ap);
+    va_end(ap);
+    fprintf(stderr, "\n");
+    
+    abort();
+}
@@ -0,0 +1,49 @@
+/*
+ * TOSEMU - an emulated environment for TOS applications
+ * Copyright (C) 2014 Johan Thelin <e8johan@gmail.com>
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+#ifndef VERIFY_H
+#define VERIFY_H
+
+/* Shadow execution
+ *
+ * With --verify, the results of each fast path are checked against the 
+ * simple path they replace, and tosemu aborts at the first mismatch:
+ *
+ * - trap arguments decoded from host memory against reads through tos_read()
+ * - cached program images against copying and relocating the binary
+ * - cached disassembly of the -v trace against m68k_disassemble()
+ * - host blocks from tos_range_to_host_mem() against per byte lookups
+ * - the memory areas over te->ram against its direct use at the same offsets
+ * - guest RAM cleared with madvise() against reading back zeroes
+ *
+ * A new fast path should check itself the same way, under VERIFYING().
+ */
+
+/* Non-zero with --verify */
+extern int verify_enabled;
+
+#define VERIFYING() __builtin_expect(verify_enabled, 0)
+
+/* Prints what differed between the fast and the simple path, along with the
+ * program and PC, to stderr and aborts */
+void verify_failed(const char *format, ...)
+    __attribute__((noreturn, format(printf, 1, 2)));
+
+#endif /* VERIFY_H */
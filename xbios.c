@@ -27,38 +27,39 @@
 #include "memory.h"
 #include "cpu.h"
 #include "m68k.h"
-
-#define XBIOS_TRACE_CONTEXT
-#include "config.h"
+#include "trace.h"
 
 /* XBIOS functions */
 
-uint32_t XBIOS_Getrez()
+uint32_t XBIOS_Getrez(const uint32_t *args)
 {
-    FUNC_TRACE_ENTER
-    
     /* Custom value, to ensure that HW-dependent code fails */
     return 8;
 }
 
-static uint32_t dreg[5], areg[4];
+/* Registers saved across a Supexec call */
+struct xbios_state {
+    uint32_t dreg[5], areg[4];
+};
 
 static void save_regs(void)
 {
+    struct xbios_state *xs = tos_current->xbios;
     int i;
     for(i=0; i<5; i++)
-        dreg[i] = m68k_get_reg(0, M68K_REG_D3+i);
+        xs->dreg[i] = m68k_get_reg(0, M68K_REG_D3+i);
     for(i=0; i<4; i++)
-        areg[i] = m68k_get_reg(0, M68K_REG_A3+i);
+        xs->areg[i] = m68k_get_reg(0, M68K_REG_A3+i);
 }
 
 static void restore_regs(void)
 {
+    struct xbios_state *xs = tos_current->xbios;
     int i;
     for(i=0; i<5; i++)
-        m68k_set_reg(M68K_REG_D3+i, dreg[i]);
+        m68k_set_reg(M68K_REG_D3+i, xs->dreg[i]);
     for(i=0; i<4; i++)
-        m68k_set_reg(M68K_REG_A3+i, areg[i]);
+        m68k_set_reg(M68K_REG_A3+i, xs->areg[i]);
 }
 
 /* Supexec has been implemented using magic memory, which provides a mechanism 
@@ -77,14 +78,10 @@ static void restore_regs(void)
  * error).  The instruction at 0x200 will be executed before the PC update
  * takes effect, so the memory reads return a NOP at that address.
  */
-uint32_t XBIOS_Supexec()
+uint32_t XBIOS_Supexec(const uint32_t *args)
 {
-    uint32_t lv0 = peek_u32(2);
+    uint32_t lv0 = args[0];
 
-    FUNC_TRACE_ENTER_ARGS {
-        printf("    0x%x\n", lv0);
-    }
-    
     save_regs();
 
     enable_supervisor_mode();
@@ -122,15 +119,11 @@ void magic_xbios_supexec_write(struct _memarea *area, uint32_t address, uint8_t
 
 /* Keyboard table functions **************************************************/
 
-uint32_t XBIOS_Keytbl()
+uint32_t XBIOS_Keytbl(const uint32_t *args)
 {
-    uint32_t unshift = peek_u32(2);
-    uint32_t shift = peek_u32(6);
-    uint32_t capslock = peek_u32(10);
-
-    FUNC_TRACE_ENTER_ARGS {
-        printf("    unshift : 0x%x\n    shift   : 0x%x\n    capslock: 0x%x\n", unshift, shift, capslock);
-    }
+    uint32_t unshift = args[0];
+    uint32_t shift = args[1];
+    uint32_t capslock = args[2];
 
     /* TODO to support writing to these tables, the keyboard mapping needs to
      * be supported in general. At the moment, the system relies on the mapping
@@ -154,7 +147,7 @@ uint32_t XBIOS_Keytbl()
 
     return 0; /* TODO return a pointer to the table in some pre-allocated place in ST RAM */
 }
-uint32_t XBIOS_Bioskeys()
+uint32_t XBIOS_Bioskeys(const uint32_t *args)
 {
     /* TODO this is a nop, as we do not use the keyboard tables at the moment */
     return 0;
@@ -275,13 +268,14 @@ uint32_t XBIOS_Bioskeys()
  */
 struct XBIOS_function {
     char *name;
-    uint32_t (*fnct)();
+    uint32_t (*fnct)(const uint32_t *args);
     uint16_t id;
+    const char *args; /* Argument signature, see decode_trap_args */
 };
 
 struct XBIOS_function XBIOS_functions[] = {
     {"Bconmap", XBIOS_Bconmap, 0x2C},
-    {"Bioskeys", XBIOS_Bioskeys, 0x18},
+    {"Bioskeys", XBIOS_Bioskeys, 0x18, ""},
     {"Blitmode", XBIOS_Blitmode, 0x40},
     {"Buffoper", XBIOS_Buffoper, 0x88},
     {"Buffptr", XBIOS_Buffptr, 0x8D},
@@ -337,7 +331,7 @@ struct XBIOS_function XBIOS_functions[] = {
     {"Floprd", XBIOS_Floprd, 0x08},
     {"Flopver", XBIOS_Flopver, 0x13},
     {"Flopwr", XBIOS_Flopwr, 0x09},
-    {"Getrez",      XBIOS_Getrez, 0x04},
+    {"Getrez",      XBIOS_Getrez, 0x04, ""},
     {"Gettime", XBIOS_Gettime, 0x17},
     {"Glaccess", XBIOS_Glaccess, 0x1C},
     {"Gpio", XBIOS_Gpio, 0x8A},
@@ -348,7 +342,7 @@ struct XBIOS_function XBIOS_functions[] = {
     {"Jenabint", XBIOS_Jenabint, 0x1B},
     {"Kbdvbase", XBIOS_Kbdvbase, 0x22},
     {"Kbrate", XBIOS_Kbrate, 0x23},
-    {"Keytbl", XBIOS_Keytbl, 0x10},
+    {"Keytbl", XBIOS_Keytbl, 0x10, "ppp"},
     {"Locksnd", XBIOS_Locksnd, 0x80},
     {"Logbase", XBIOS_Logbase, 0x03},
     {"Metainit", XBIOS_Metainit, 0x30},
@@ -377,7 +371,7 @@ struct XBIOS_function XBIOS_functions[] = {
     {"Sndstatus", XBIOS_Sndstatus, 0x8C},
     {"Soundcmd", XBIOS_Soundcmd, 0x82},
     {"Ssbrk", XBIOS_Ssbrk, 0x01},
-    {"Supexec", XBIOS_Supexec, 0x26},
+    {"Supexec", XBIOS_Supexec, 0x26, "p"},
     {"Unlocksnd", XBIOS_Unlocksnd, 0x81},
     {"VgetMonitor", XBIOS_VgetMonitor, 0x59},
     {"VgetRGB", XBIOS_VgetRGB, 0x5E},
@@ -392,20 +386,40 @@ struct XBIOS_function XBIOS_functions[] = {
     {"Xbtimer", XBIOS_Xbtimer, 0x1F}
 };
 
+const char *xbios_function_name(int i)
+{
+    if (i < 0 || i >= sizeof(XBIOS_functions)/sizeof(struct XBIOS_function))
+        return 0;
+    
+    return XBIOS_functions[i].name;
+}
+
 void xbios_trap()
 {
     uint16_t fnct = peek_u16(0);
+    uint32_t args[TRAP_ARGS_MAX];
     int i;
     
-    for(i=0; i<=sizeof(XBIOS_functions)/sizeof(struct XBIOS_function); ++i) {
+    for(i=0; i<sizeof(XBIOS_functions)/sizeof(struct XBIOS_function); ++i) {
         if (XBIOS_functions[i].id == fnct) {
             if (XBIOS_functions[i].fnct) {
-                m68k_set_reg(M68K_REG_D0, XBIOS_functions[i].fnct());
+                uint32_t r;
+                
+                decode_trap_args(XBIOS_functions[i].args, args);
+                if (TRACING(STATS_XBIOS))
+                    r = trace_call(STATS_XBIOS, XBIOS_functions[i].name, XBIOS_functions[i].args,
+                                   XBIOS_functions[i].fnct, args);
+                else
+                    r = XBIOS_functions[i].fnct(args);
+                m68k_set_reg(M68K_REG_D0, r);
             } else {
                 halt_execution();
                 printf("XBIOS %s (0x%x) not implemented\n", XBIOS_functions[i].name, fnct);
             }
             
+            /* A parked call is counted once it is retried and completes */
+            if (!TRAP_PARKED())
+                STATS_CALL(STATS_XBIOS, i);
             return;
         }
     }
@@ -413,3 +427,16 @@ void xbios_trap()
     halt_execution();
     printf("XBIOS Unknown function called 0x%x\n", fnct);
 }
+
+int xbios_init(struct tos_environment *te)
+{
+    te->xbios = calloc(1, sizeof(struct xbios_state));
+    
+    return te->xbios ? 0 : -1;
+}
+
+void xbios_free(struct tos_environment *te)
+{
+    free(te->xbios);
+    te->xbios = 0;
+}
@@ -23,9 +23,18 @@
 
 #include <stdint.h>
 #include "memory.h"
+#include "tossystem.h"
+
+/* Set up and free the XBIOS state of an environment, init returns 0 on 
+ * success */
+int xbios_init(struct tos_environment *te);
+void xbios_free(struct tos_environment *te);
 
 void xbios_trap();
 
+/* Returns the name of the function at index in the dispatch table, or 0 */
+const char *xbios_function_name(int index);
+
 uint8_t magic_xbios_supexec_read(struct _memarea *area, uint32_t address);
 void magic_xbios_supexec_write(struct _memarea *area, uint32_t address, uint8_t value);
 